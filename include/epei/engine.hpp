@@ -9,28 +9,169 @@
 #ifndef ENGINE_HPP
 #define ENGINE_HPP
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
 #include <memory>
 #include <string>
 #include <vector>
 
 namespace epei {
 
+// 查询的限制，0 表示不限制
+struct QueryOptions {
+    uint32_t timeout = 0;       // 最长执行时间（毫秒），超时的查询返回部分结果
+    uint32_t memory_limit = 0;  // 可以使用的内存（MB），超过上限的查询不返回结果
+    // 取消标记，查询执行时可以在其他线程中设置为 true，查询停止并返回部分结果
+    std::shared_ptr<std::atomic<bool>> cancel;
+};
+
+// 打开数据库的选项
+struct OpenOptions {
+    // 生成查询计划时采样估计基数的时间（微秒），0 表示只使用统计信息
+    uint32_t sampling_budget = 0;
+    // 索引文件的加载策略，例如 "populate,ENTITY_INDEX_ARRAYS:lazy"，空字符串使用默认策略，
+    // 格式错误时抛出 std::invalid_argument
+    std::string load_policy;
+};
+
+// 查询结果，保存的是 id，遍历时才解码为字符串
+class QueryResult {
+   public:
+    // 内部实现，由 Statement 创建
+    class Impl;
+
+    explicit QueryResult(std::shared_ptr<Impl> impl) : _impl(std::move(impl)) {}
+
+    class Iterator {
+       public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = std::vector<std::string>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = value_type;
+
+        Iterator(const QueryResult* result, size_t idx) : result_(result), idx_(idx) {}
+
+        value_type operator*() const { return result_->Row(idx_); }
+
+        Iterator& operator++() {
+            ++idx_;
+            return *this;
+        }
+
+        bool operator==(const Iterator& other) const { return idx_ == other.idx_; }
+
+        bool operator!=(const Iterator& other) const { return idx_ != other.idx_; }
+
+       private:
+        const QueryResult* result_;
+        size_t idx_;
+    };
+
+    // 投影变量，每一行的值按照这个顺序排列
+    const std::vector<std::string>& Variables() const;
+
+    size_t Size() const;
+
+    // 第 i 行，没有绑定的变量为空字符串
+    std::vector<std::string> Row(size_t i) const;
+
+    Iterator begin() const { return Iterator(this, 0); }
+
+    Iterator end() const { return Iterator(this, Size()); }
+
+    bool TimedOut() const;
+
+    // 被 QueryOptions::cancel 取消
+    bool Cancelled() const;
+
+    bool MemoryExceeded() const;
+
+    // 执行时间（毫秒）
+    double Duration() const;
+
+    // 执行过程中占用的最大内存（字节）
+    size_t PeakMemory() const;
+
+   private:
+    std::shared_ptr<Impl> _impl;
+};
+
+// 解析过的查询，可以被执行多次。
+// 查询中的常量可以写成参数（例如 SELECT ?x WHERE { ?x <knows> $person . }），执行时按顺序绑定
+class Statement {
+   public:
+    // 内部实现，由 Engine 创建
+    class Impl;
+
+    explicit Statement(std::shared_ptr<Impl> impl) : _impl(std::move(impl)) {}
+
+    const std::vector<std::string>& Variables() const;
+
+    // 按照第一次出现的顺序排列的参数名
+    const std::vector<std::string>& Parameters() const;
+
+    QueryResult Execute(const QueryOptions& options = {}) const;
+
+    // parameters 中的值与查询中常量的写法相同，例如 <http://a>、"abc"，个数与 Parameters() 不同时抛出异常
+    QueryResult Execute(const std::vector<std::string>& parameters, const QueryOptions& options = {}) const;
+
+   private:
+    std::shared_ptr<Impl> _impl;
+};
+
 class Engine {
    private:
     class Impl;
 
    public:
-    Engine() = delete;
+    static void Create(const std::string& db_name, const std::string& data_file);
 
-    ~Engine() = delete;
+    // options 是每个查询的限制，open 是打开数据库的选项。
+    // params_file 不为空时，文件中的每个查询对其中的每一行参数（制表符分隔）执行一次
+    static void Query(const std::string& db_name,
+                      const std::string& data_file,
+                      const QueryOptions& options = {},
+                      const OpenOptions& open = {},
+                      const std::string& params_file = "");
 
-    static void Create(const std::string& db_name, const std::string& data_file);
+    // 使用 workers 个线程并发执行文件中的查询，output_dir 为空时丢弃结果，最后输出延迟和吞吐量
+    static void Batch(const std::string& db_name,
+                      const std::string& data_file,
+                      uint32_t workers,
+                      const std::string& output_dir,
+                      const QueryOptions& options = {},
+                      const OpenOptions& open = {});
 
-    static void Query(const std::string& db_name, const std::string& data_file);
+    // options 是查询的默认限制，timeout 可以被 HTTP 请求的 timeout 参数覆盖，cancel 不使用。
+    // result_cache: 查询结果缓存可以使用的内存（MB），0 表示不缓存
+    static void Server(const std::string& ip,
+                       const std::string& port,
+                       const std::string& db,
+                       const QueryOptions& options = {},
+                       const OpenOptions& open = {},
+                       uint32_t result_cache = 64);
 
-    static void Server(const std::string& ip, const std::string& port, const std::string& db);
+    // 打开数据库，数据库只加载一次，之后可以执行任意多个查询。
+    // 返回的 Engine 可以被复制并在多个线程中使用，最后一个引用数据库的对象析构时关闭数据库。
+    // 数据库不存在时抛出 std::runtime_error
+    static Engine Open(const std::string& db_name, const OpenOptions& open = {});
+
+    // 解析查询，语法错误时抛出异常。
+    // 查询计划按照查询的模板缓存，常量不同的同一种查询共享计划的结构
+    Statement Prepare(const std::string& sparql) const;
+
+    QueryResult Execute(const std::string& sparql, const QueryOptions& options = {}) const;
+
+    // 生成查询计划时在 microseconds 微秒内从索引中采样，修正统计信息对候选集合和连接大小的估计，
+    // 0（默认）表示只使用统计信息。计划按模板缓存，修改后清空已经缓存的计划
+    void SetSamplingBudget(uint32_t microseconds) const;
+
+   private:
+    explicit Engine(std::shared_ptr<Impl> impl) : _impl(std::move(impl)) {}
 
-   public:
     std::shared_ptr<Impl> _impl;
 };
 
@@ -0,0 +1,71 @@
+/*
+ * 字典查找的微基准：加载 ./DB_DATA_ARCHIVE/<db_name>/dictionary，然后
+ * 对每一个实体查找 rounds 次（命中），再对每一个实体加上后缀 "x" 查找 rounds 次（未命中），
+ * 输出每次 String2ID 和 ID2String 的平均时间。单线程执行，结果只依赖字典本身。
+ * 第三个参数是 compressed 时以前缀压缩的方式加载字典（DICTIONARY:compressed）。
+ *
+ * Usage: dictionary_bench <db_name> [rounds] [plain|compressed]
+ */
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "store/dictionary.hpp"
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <db_name> [rounds] [plain|compressed]" << std::endl;
+        return 1;
+    }
+    std::string path = std::string("./DB_DATA_ARCHIVE/") + argv[1] + "/dictionary/";
+    uint rounds = argc > 2 ? std::stoul(argv[2]) : 10;
+    bool compressed = argc > 3 && std::string(argv[3]) == "compressed";
+    if (!std::filesystem::exists(path)) {
+        std::cerr << "database " << argv[1] << " doesn't exist" << std::endl;
+        return 1;
+    }
+
+    Dictionary dict(path);
+    auto load_start = std::chrono::high_resolution_clock::now();
+    dict.Load(compressed);
+    std::chrono::duration<double, std::milli> load_time = std::chrono::high_resolution_clock::now() - load_start;
+    std::cout << "load " << load_time.count() << " ms, " << dict.max_id() << " entities." << std::endl;
+
+    std::vector<std::string> terms;
+    std::vector<std::string> missing;
+    terms.reserve(dict.max_id());
+    missing.reserve(dict.max_id());
+    std::string scratch;
+    auto decode_start = std::chrono::high_resolution_clock::now();
+    for (uint id = 1; id <= dict.max_id(); id++) {
+        terms.emplace_back(dict.ID2String(id, kSubject, scratch));
+    }
+    std::chrono::duration<double, std::nano> decode_time = std::chrono::high_resolution_clock::now() - decode_start;
+    for (const auto& term : terms) {
+        missing.push_back(term + "x");
+    }
+    if (!terms.empty())
+        std::cout << "ID2String " << decode_time.count() / terms.size() << " ns/op" << std::endl;
+
+    // checksum 防止查找被优化掉，不同版本的字典对同一个数据库应该得到相同的值
+    auto run = [&](const std::vector<std::string>& queries, Pos pos, const char* name) {
+        size_t checksum = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (uint r = 0; r < rounds; r++) {
+            for (const auto& query : queries) {
+                checksum += dict.String2ID(query, pos);
+            }
+        }
+        std::chrono::duration<double, std::nano> time = std::chrono::high_resolution_clock::now() - start;
+        double ops = double(rounds) * queries.size();
+        std::cout << "String2ID " << name << " " << (ops > 0 ? time.count() / ops : 0) << " ns/op (checksum "
+                  << checksum << ")" << std::endl;
+    };
+    run(terms, kSubject, "hit-subject");
+    run(terms, kObject, "hit-object");
+    run(missing, kSubject, "miss-subject");
+    run(missing, kObject, "miss-object");
+    return 0;
+}
@@ -0,0 +1,78 @@
+/*
+ * SELECT DISTINCT 的回归测试：在当前目录的 DB_DATA_ARCHIVE 中创建一个小数据库 distinct_test，
+ * 执行查询并与期望的结果比较。实体 id 与字符串的顺序无关，相同的行在结果中可能不相邻，
+ * 例如 { ?x <knows> ?y . } 按 ?y 枚举时 ?x 依次是 <c> <d> <a> <b> <d> <a>，DISTINCT 也要删除这些重复。
+ * 全部通过时返回 0。
+ *
+ * Usage: distinct_test
+ */
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <epei/engine.hpp>
+
+int main() {
+    const std::string db_name = "distinct_test";
+    const std::string data_file = db_name + ".nt";
+    {
+        std::ofstream out(data_file);
+        out << "<a> <knows> <b> .\n"
+               "<a> <knows> <c> .\n"
+               "<b> <knows> <c> .\n"
+               "<c> <knows> <b> .\n"
+               "<d> <knows> <b> .\n"
+               "<d> <knows> <c> .\n"
+               "<a> <likes> <d> .\n"
+               "<e> <likes> <a> .\n";
+    }
+    std::filesystem::remove_all("./DB_DATA_ARCHIVE/" + db_name);
+    epei::Engine::Create(db_name, data_file);
+    epei::Engine engine = epei::Engine::Open(db_name);
+
+    struct Case {
+        std::string sparql;
+        // 没有 LIMIT 时是全部结果；有 LIMIT 时结果是其中 size 个不同的行
+        std::vector<std::vector<std::string>> expected;
+        size_t size;
+    };
+    std::vector<Case> cases = {
+        {"SELECT DISTINCT ?x WHERE { ?x <knows> ?y . }", {{"<a>"}, {"<b>"}, {"<c>"}, {"<d>"}}, 4},
+        {"SELECT DISTINCT ?y WHERE { ?x <knows> ?y . }", {{"<b>"}, {"<c>"}}, 2},
+        {"SELECT DISTINCT ?x WHERE { ?x <knows> ?y . ?y <knows> ?z . }", {{"<a>"}, {"<b>"}, {"<c>"}, {"<d>"}}, 4},
+        {"SELECT DISTINCT ?x WHERE { { ?x <knows> ?y . } UNION { ?x <likes> ?y . } }",
+         {{"<a>"}, {"<b>"}, {"<c>"}, {"<d>"}, {"<e>"}},
+         5},
+        {"SELECT DISTINCT ?x WHERE { { ?x <knows> ?y . } UNION { ?x <likes> ?y . } } LIMIT 3",
+         {{"<a>"}, {"<b>"}, {"<c>"}, {"<d>"}, {"<e>"}},
+         3},
+    };
+
+    int failed = 0;
+    for (const auto& test : cases) {
+        std::vector<std::vector<std::string>> rows;
+        for (const auto& row : engine.Execute(test.sparql)) {
+            rows.push_back(row);
+        }
+        std::sort(rows.begin(), rows.end());
+        bool ok = rows.size() == test.size && std::adjacent_find(rows.begin(), rows.end()) == rows.end() &&
+                  std::includes(test.expected.begin(), test.expected.end(), rows.begin(), rows.end());
+        if (!ok) {
+            failed++;
+            std::cerr << "FAILED: " << test.sparql << "\n  got";
+            for (const auto& row : rows) {
+                for (const auto& value : row) {
+                    std::cerr << " " << value;
+                }
+                std::cerr << " |";
+            }
+            std::cerr << std::endl;
+        }
+    }
+    std::cout << cases.size() - failed << "/" << cases.size() << " passed" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,107 @@
+/*
+ * FrontCodedStrings 的测试：对几组排好序的字符串检查 Get 能还原每一个字符串，Find 能找到每一个字符串的位置，
+ * 不存在的字符串（比已有的字符串多或少一个字符、在两个字符串之间、在所有字符串之前或之后）返回 size()。
+ * 覆盖空集合、只有一个字符串、长度不是 kBlockSize 倍数的集合，以及去掉公共前缀后前 8 个字节（块键）相同的块。
+ * 全部通过时返回 0。
+ *
+ * Usage: front_coding_test
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "store/front_coding.hpp"
+
+// 检查一组字符串，返回失败的检查个数
+static int Check(const std::string& name, std::vector<std::string> terms) {
+    std::sort(terms.begin(), terms.end());
+    terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+    std::vector<std::string_view> views(terms.begin(), terms.end());
+
+    // 与 Dictionary 加载时相同：命名空间来自所有块头
+    std::vector<std::string_view> headers;
+    for (size_t i = 0; i < views.size(); i += FrontCodedStrings::kBlockSize) {
+        headers.push_back(views[i]);
+    }
+    Namespaces namespaces;
+    namespaces.Build(headers);
+    FrontCodedStrings strings(views, &namespaces);
+
+    int failed = 0;
+    auto fail = [&](const std::string& what) {
+        failed++;
+        std::cerr << "FAILED " << name << ": " << what << std::endl;
+    };
+    auto missing = [&](const std::string& term) {
+        if (!std::binary_search(terms.begin(), terms.end(), term) && strings.Find(term) != strings.size())
+            fail("found missing term " + term);
+    };
+
+    if (strings.size() != terms.size())
+        fail("size " + std::to_string(strings.size()));
+    std::string decoded;
+    for (uint rank = 0; rank < terms.size(); rank++) {
+        strings.Get(rank, decoded);
+        if (decoded != terms[rank])
+            fail("Get(" + std::to_string(rank) + ") = " + decoded);
+        if (strings.Find(terms[rank]) != rank)
+            fail("Find(" + terms[rank] + ") = " + std::to_string(strings.Find(terms[rank])));
+        missing(terms[rank] + "a");
+        missing(terms[rank] + '\x01');
+        missing(terms[rank] + '\xff');
+        missing(terms[rank].substr(0, terms[rank].size() - 1));
+    }
+    missing("");
+    missing("!");
+    missing("\xff");
+    missing("<http://example.org/");
+    missing("<http://example.org/zzzz");
+    return failed;
+}
+
+int main() {
+    const std::string ns = "<http://example.org/";
+    int failed = 0;
+
+    failed += Check("empty", {});
+    failed += Check("single", {ns + "a>"});
+    failed += Check("single literal", {"\"x\""});
+
+    // 长度为 1 到 3 * kBlockSize + 1 的集合，最后一块不满
+    for (uint n = 1; n <= 3 * FrontCodedStrings::kBlockSize + 1; n++) {
+        std::vector<std::string> terms;
+        for (uint i = 0; i < n; i++) {
+            terms.push_back(ns + "e" + std::to_string(1000 + i * 7) + ">");
+        }
+        failed += Check("length " + std::to_string(n), terms);
+    }
+
+    // 公共前缀之后的前 8 个字节都是 "abcdefgh"，所有块的块键相同，只能比较完整的块头
+    {
+        std::vector<std::string> terms;
+        for (uint i = 0; i < 5 * FrontCodedStrings::kBlockSize + 3; i++) {
+            terms.push_back(ns + "abcdefgh" + std::to_string(i) + ">");
+        }
+        terms.push_back(ns + "a>");
+        terms.push_back(ns + "z>");
+        failed += Check("shared block keys", terms);
+    }
+
+    // 不到 8 个字节的后缀（块键补 0）、不同的命名空间和没有命名空间的字面量混在一起
+    {
+        std::vector<std::string> terms;
+        for (const char* suffix : {"", "a", "ab", "abc", "abcdefg", "abcdefgh", "abcdefghi", "b"}) {
+            terms.push_back(ns + suffix + ">");
+            terms.push_back("<http://other.org/ns#" + std::string(suffix) + ">");
+            terms.push_back("\"" + std::string(suffix) + "\"");
+            terms.push_back("\"" + std::string(suffix) + "\"@en");
+        }
+        failed += Check("mixed", terms);
+    }
+
+    if (failed == 0)
+        std::cout << "all passed" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
@@ -19,8 +19,30 @@ void Query(const std::unordered_map<std::string, std::string>& arguments) {
         db_name = arguments.at("name");
     if (arguments.count("file"))
         sparql_file = arguments.at("file");
+    epei::QueryOptions options;
+    options.timeout = std::stoul(arguments.at("timeout"));
+    options.memory_limit = std::stoul(arguments.at("memory_limit"));
 
-    epei::Engine::Query(db_name, sparql_file);
+    uint32_t workers = std::stoul(arguments.at("batch"));
+    std::string output_dir;
+    if (arguments.count("output"))
+        output_dir = arguments.at("output");
+    std::string params_file;
+    if (arguments.count("params"))
+        params_file = arguments.at("params");
+    epei::OpenOptions open;
+    open.sampling_budget = std::stoul(arguments.at("sampling_budget"));
+    open.load_policy = arguments.at("load_policy");
+
+    try {
+        if (workers > 0)
+            epei::Engine::Batch(db_name, sparql_file, workers, output_dir, options, open);
+        else
+            epei::Engine::Query(db_name, sparql_file, options, open, params_file);
+    } catch (const std::exception& e) {
+        std::cerr << "epei: error: " << e.what() << std::endl;
+        exit(1);
+    }
 }
 
 void Server(const std::unordered_map<std::string, std::string>& arguments) {
@@ -29,7 +51,19 @@ void Server(const std::unordered_map<std::string, std::string>& arguments) {
     std::string db = "";
     if (arguments.count("name"))
         db = arguments.at("name");
-    epei::Engine::Server(ip, port, db);
+    epei::QueryOptions options;
+    options.timeout = std::stoul(arguments.at("timeout"));
+    options.memory_limit = std::stoul(arguments.at("memory_limit"));
+    uint32_t result_cache = std::stoul(arguments.at("result_cache"));
+    epei::OpenOptions open;
+    open.sampling_budget = std::stoul(arguments.at("sampling_budget"));
+    open.load_policy = arguments.at("load_policy");
+    try {
+        epei::Engine::Server(ip, port, db, options, open, result_cache);
+    } catch (const std::exception& e) {
+        std::cerr << "epei: error: " << e.what() << std::endl;
+        exit(1);
+    }
 }
 
 struct EnumClassHash {
@@ -32,6 +32,14 @@ class ArgsParser {
     const std::string arg_port_ = "port";
     const std::string arg_thread_num_ = "thread_num";
     const std::string arg_chunk_size_ = "chunk_size";
+    const std::string arg_timeout_ = "timeout";
+    const std::string arg_memory_limit_ = "memory_limit";
+    const std::string arg_batch_ = "batch";
+    const std::string arg_output_ = "output";
+    const std::string arg_params_ = "params";
+    const std::string arg_result_cache_ = "result_cache";
+    const std::string arg_sampling_budget_ = "sampling_budget";
+    const std::string arg_load_policy_ = "load_policy";
 
    private:
     std::unordered_map<std::string, CommandT> position_ = {
@@ -131,7 +139,9 @@ class ArgsParser {
         "  epei build --db my_database -f /path/to/data.rdf\n";
 
     const std::string query_info_ =
-        "Usage: epei query [--db, --database DATABASE] [-f,--file FILE]\n"
+        "Usage: epei query [--db, --database DATABASE] [-f,--file FILE] [--timeout MS] [--memory-limit MB]\n"
+        "                  [--batch N] [-o,--output DIR] [--params FILE] [--sample-budget US]\n"
+        "                  [--load-policy POLICY]\n"
         "\n"
         "Description:\n"
         "Query the data from the given RDF database using SPARQLs in the given file.\n"
@@ -142,9 +152,23 @@ class ArgsParser {
         "\n"
         "Optional Arguments:\n"
         "  -h, --help          Show this help message and exit.\n"
+        "  --timeout <MS>      Stop each query after MS milliseconds and output the partial results.\n"
+        "  --memory-limit <MB> Abort each query that uses more than MB megabytes of memory.\n"
+        "  --batch <N>         Execute the queries concurrently on N workers and report the latency and throughput.\n"
+        "  -o, --output <DIR>  In batch mode, write the results of each query to DIR/<line>.txt instead of discarding them.\n"
+        "  --params <FILE>     Execute each query once for every line of FILE, binding the tab-separated values\n"
+        "                      to the $parameters of the query in order of appearance.\n"
+        "  --sample-budget <US> Spend up to US microseconds sampling the index to estimate cardinalities\n"
+        "                      when planning each query, 0 uses the statistics only (default 0).\n"
+        "  --load-policy <POLICY> How to load the index files: lazy, willneed, populate, mlock, hugepage\n"
+        "                      or trace, optionally followed by FILE:POLICY for single files,\n"
+        "                      e.g. populate,ENTITY_INDEX_ARRAYS:lazy. DICTIONARY:compressed keeps the\n"
+        "                      dictionary front-coded in memory.\n"
         "\n"
         "Examples:\n"
-        "  epei query --db my_database -f /path/to/query.sparql\n";
+        "  epei query --db my_database -f /path/to/query.sparql\n"
+        "  epei query --db my_database -f /path/to/query.sparql --batch 8 -o /path/to/results\n"
+        "  epei query --db my_database -f /path/to/template.sparql --params /path/to/params.tsv\n";
 
     const std::string serve_info_ =
         "Usage: epei server [--ip IP] [-p,--port PORT] \n"
@@ -159,6 +183,11 @@ class ArgsParser {
         "\n"
         "Optional Arguments:\n"
         "  -h, --help          Show this help message and exit.\n"
+        "  --timeout <MS>      Default query timeout in milliseconds, overridden by the `timeout` parameter.\n"
+        "  --memory-limit <MB> Abort each query that uses more than MB megabytes of memory.\n"
+        "  --result-cache <MB> Cache the results of repeated queries in MB megabytes, 0 disables it (default 64).\n"
+        "  --sample-budget <US> Spend up to US microseconds sampling the index when planning a query (default 0).\n"
+        "  --load-policy <POLICY> How to load the index files, see `epei query --help`.\n"
         "\n"
         "Examples:\n"
         "  epei server --port 8080;\n";
@@ -205,6 +234,17 @@ class ArgsParser {
             arguments_[arg_thread_num_] = args.at("-t");
         else
             arguments_[arg_thread_num_] = std::to_string(default_thread_num);
+
+        ParseLimits(args);
+        ParseNumber(args, "--batch", "N", arg_batch_);
+        if (args.count("-o"))
+            arguments_[arg_output_] = args.at("-o");
+        else if (args.count("--output"))
+            arguments_[arg_output_] = args.at("--output");
+        if (args.count("--params"))
+            arguments_[arg_params_] = args.at("--params");
+        ParseNumber(args, "--sample-budget", "US", arg_sampling_budget_);
+        ParseLoadPolicy(args);
     }
 
     void Server(const std::unordered_map<std::string, std::string>& args) {
@@ -227,6 +267,39 @@ class ArgsParser {
                       << arguments_[arg_port_] << std::endl;
             exit(1);
         }
+
+        ParseLimits(args);
+        ParseNumber(args, "--result-cache", "MB", arg_result_cache_, "64");
+        ParseNumber(args, "--sample-budget", "US", arg_sampling_budget_);
+        ParseLoadPolicy(args);
+    }
+
+    // 索引文件的加载策略，由引擎检查格式
+    void ParseLoadPolicy(const std::unordered_map<std::string, std::string>& args) {
+        arguments_[arg_load_policy_] = args.count("--load-policy") ? args.at("--load-policy") : "";
+    }
+
+    // 查询的时间和内存限制，默认为 0（不限制）
+    void ParseLimits(const std::unordered_map<std::string, std::string>& args) {
+        ParseNumber(args, "--timeout", "MS", arg_timeout_);
+        ParseNumber(args, "--memory-limit", "MB", arg_memory_limit_);
+    }
+
+    void ParseNumber(const std::unordered_map<std::string, std::string>& args,
+                     const std::string& flag,
+                     const std::string& unit,
+                     const std::string& name,
+                     const std::string& default_value = "0") {
+        if (!args.count(flag)) {
+            arguments_[name] = default_value;
+            return;
+        }
+        arguments_[name] = args.at(flag);
+        if (!IsNumber(arguments_[name]) || arguments_[name].empty() || arguments_[name].size() > 9) {
+            std::cerr << "epei: error: the argument [" << flag << " " << unit << "] requires a number, but got "
+                      << arguments_[name] << std::endl;
+            exit(1);
+        }
     }
 
     inline bool IsNumber(const std::string& s) {
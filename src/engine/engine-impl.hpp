@@ -9,22 +9,155 @@
 #ifndef ENGINE_IMPL_HPP
 #define ENGINE_IMPL_HPP
 
+#include <algorithm>
+#include <filesystem>
 #include <fstream>
 #include <memory>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 #include <epei/engine.hpp>
 
 #include "parser/sparql_parser.hpp"
+#include "query/aggregate_executor.hpp"
+#include "query/plan_cache.hpp"
 #include "query/query_executor.hpp"
+#include "query/query_guard.hpp"
 #include "query/query_plan.hpp"
 #include "query/query_result.hpp"
+#include "query/union_executor.hpp"
 #include "server/server.hpp"
 #include "store/index_builder.hpp"
 #include "store/index_retriever.hpp"
+#include "tools/thread_pool.hpp"
+
+// 查询结果保存 id 和每一列的 (位置, Pos)，遍历时才解码；聚合查询的结果已经是字符串
+class epei::QueryResult::Impl {
+   public:
+    std::vector<std::string> variables_;
+    std::shared_ptr<IndexRetriever> index_;
+    std::vector<std::vector<uint>> rows_;
+    std::vector<std::pair<uint, Pos>> columns_;
+    std::vector<std::vector<std::string>> strings_;
+    bool decoded_ = false;
+    std::shared_ptr<QueryGuard> guard_;
+    double duration_ = 0;
+
+    size_t Size() const { return decoded_ ? strings_.size() : rows_.size(); }
+
+    std::vector<std::string> Row(size_t i) const {
+        if (decoded_)
+            return strings_[i];
+        std::vector<std::string> row;
+        row.reserve(columns_.size());
+        std::string scratch;
+        for (const auto& [column, pos] : columns_) {
+            uint id = rows_[i][column];
+            row.emplace_back(id ? index_->ID2String(id, pos, scratch) : std::string_view());
+        }
+        return row;
+    }
+};
+
+// 解析好的查询，没有 UNION 和聚合的查询在准备时就生成查询计划，之后每次执行都使用这个计划。
+// 带参数的查询在每次执行时绑定参数，计划从 plan_cache 中获取，只需要重新查找参数对应的结果
+class epei::Statement::Impl {
+   public:
+    Impl(const std::shared_ptr<IndexRetriever>& index,
+         const std::string& sparql,
+         const std::shared_ptr<PlanCache>& plan_cache = nullptr,
+         const std::shared_ptr<BS::thread_pool>& thread_pool = nullptr)
+        : index_(index),
+          parser_(std::make_shared<SPARQLParser>(sparql)),
+          plan_cache_(plan_cache),
+          thread_pool_(thread_pool) {
+        if (parser_->Parameters().empty() && !parser_->HasAggregate() && !parser_->HasUnion())
+            plan_ = Plan(*parser_);
+    }
+
+    const std::vector<std::string>& Variables() const { return parser_->ProjectVariables(); }
+
+    const std::vector<std::string>& Parameters() const { return parser_->Parameters(); }
+
+    std::shared_ptr<epei::QueryResult::Impl> Execute(const std::vector<std::string>& parameters,
+                                                     const epei::QueryOptions& options) const {
+        auto parser = parser_;
+        auto plan = plan_;
+        if (!parameters.empty() || !parser_->Parameters().empty()) {
+            parser = std::make_shared<SPARQLParser>(*parser_);
+            parser->Bind(parameters);
+            if (!parser->HasAggregate() && !parser->HasUnion())
+                plan = Plan(*parser);
+        }
+
+        auto result = std::make_shared<epei::QueryResult::Impl>();
+        result->variables_ = parser->ProjectVariables();
+        result->index_ = index_;
+        result->guard_ = std::make_shared<QueryGuard>(options.timeout, size_t(options.memory_limit) << 20);
+        result->guard_->SetCancelFlag(options.cancel);
+
+        if (parser->HasAggregate()) {
+            // plans of the branches are generated inside the executor
+            AggregateExecutor executor(index_, parser);
+            executor.SetGuard(result->guard_);
+            executor.SetPlanCache(plan_cache_);
+            executor.SetThreadPool(thread_pool_);
+            executor.Query();
+            result->duration_ = executor.Duration();
+            result->strings_ = std::move(executor.query_result());
+            result->decoded_ = true;
+        } else if (parser->HasUnion()) {
+            // plans of the branches are generated inside the executor
+            UnionExecutor executor(index_, parser);
+            executor.SetGuard(result->guard_);
+            executor.SetPlanCache(plan_cache_);
+            executor.SetThreadPool(thread_pool_);
+            executor.Query();
+            result->duration_ = executor.Duration();
+            result->rows_ = std::move(executor.query_result());
+            const auto& positions = executor.variable_positions();
+            for (uint i = 0; i < positions.size(); i++) {
+                result->columns_.emplace_back(i, positions[i]);
+            }
+        } else {
+            QueryExecutor executor(index_, plan);
+            executor.SetGuard(result->guard_);
+            executor.Query();
+            result->duration_ = executor.Duration();
+            result->rows_ = std::move(executor.query_result());
+            // project_variables 是要输出的变量顺序，而结果的变量顺序是计划生成中的变量排序
+            result->columns_ = plan->MappingVariable(result->variables_);
+            if (parser->project_modifier().modifier_type_ == SPARQLParser::ProjectModifier::Distinct)
+                distinct_rows(result->rows_, result->columns_);
+        }
+        return result;
+    }
+
+   private:
+    std::shared_ptr<QueryPlan> Plan(const SPARQLParser& parser) const {
+        if (plan_cache_)
+            return plan_cache_->Get(index_, parser.TripleList(), parser.Limit(), parser.Offset(), parser.OrderBy());
+        return std::make_shared<QueryPlan>(index_, parser.TripleList(), parser.Limit(), parser.Offset(),
+                                           parser.OrderBy());
+    }
+
+    std::shared_ptr<IndexRetriever> index_;
+    std::shared_ptr<SPARQLParser> parser_;
+    std::shared_ptr<PlanCache> plan_cache_;
+    std::shared_ptr<BS::thread_pool> thread_pool_;
+    std::shared_ptr<QueryPlan> plan_;
+};
 
 class epei::Engine::Impl {
    public:
+    Impl() = default;
+
+    Impl(const std::string& db_name, const epei::OpenOptions& open) : index_(OpenIndex(db_name, open.load_policy)) {
+        plan_cache_->SetSamplingBudget(open.sampling_budget);
+    }
+
     void Create(const std::string& db_name, const std::string& data_file) {
         auto beg = std::chrono::high_resolution_clock::now();
 
@@ -39,8 +172,14 @@ class epei::Engine::Impl {
         std::cout << "Creating " << db_name << " takes " << diff.count() << " ms." << std::endl;
     }
 
-    void ExecuteSparql(std::vector<std::string> sparqls, std::shared_ptr<IndexRetriever> index) {
-        std::ofstream output_file;
+    std::shared_ptr<epei::Statement::Impl> Prepare(const std::string& sparql) const {
+        return std::make_shared<epei::Statement::Impl>(index_, sparql, plan_cache_, thread_pool_);
+    }
+
+    // parameters 不为空时，每个查询对 parameters 中的每一组参数执行一次
+    void ExecuteSparql(const std::vector<std::string>& sparqls,
+                       const epei::QueryOptions& options,
+                       const std::vector<std::vector<std::string>>& parameters = {}) {
         std::ios::sync_with_stdio(false);
 
         for (long unsigned int i = 0; i < sparqls.size(); i++) {
@@ -52,61 +191,202 @@ class epei::Engine::Impl {
                 std::cout << sparql << std::endl;
             }
 
-            auto start = std::chrono::high_resolution_clock::now();
-
-            auto parser = std::make_shared<SPARQLParser>(sparql);
-
+            auto prepare_start = std::chrono::high_resolution_clock::now();
             // generate query plan
-            auto query_plan = std::make_shared<QueryPlan>(index, parser->TripleList(), parser->Limit());
+            epei::Statement statement(Prepare(sparql));
+            std::chrono::duration<double, std::milli> prepare_time =
+                std::chrono::high_resolution_clock::now() - prepare_start;
 
-            auto plan_end = std::chrono::high_resolution_clock::now();
-
-            // execute query
-            auto executor = std::make_shared<QueryExecutor>(index, query_plan);
+            size_t executions = std::max<size_t>(1, parameters.size());
+            for (size_t j = 0; j < executions; j++) {
+                if (!parameters.empty()) {
+                    std::cout << "parameters:";
+                    for (const auto& value : parameters[j]) {
+                        std::cout << " " << value;
+                    }
+                    std::cout << "\n";
+                }
+                ExecuteStatement(statement, parameters.empty() ? std::vector<std::string>() : parameters[j],
+                                 options, j == 0 ? prepare_time.count() : 0);
+            }
+        }
+        std::cout << "plan cache " << plan_cache_->hits() << " hit(s), " << plan_cache_->misses() << " miss(es)."
+                  << std::endl;
+        PostingCache& posting_cache = index_->posting_cache();
+        std::cout << "posting cache " << posting_cache.hits() << " hit(s), " << posting_cache.misses()
+                  << " miss(es)." << std::endl;
+    }
 
-            executor->Query();
+    // prepare_time 是准备查询的时间，同一个查询的多次执行只在第一次计入
+    void ExecuteStatement(const epei::Statement& statement,
+                          const std::vector<std::string>& parameters,
+                          const epei::QueryOptions& options,
+                          double prepare_time) {
+        auto start = std::chrono::high_resolution_clock::now();
 
-            auto mapping_start = std::chrono::high_resolution_clock::now();
-            uint cnt = 0;
-            cnt = query_result(executor->query_result(), index, query_plan, parser);
+        // execute query, the plan of a parameterized query is taken from the plan cache here
+        epei::QueryResult result = statement.Execute(parameters, options);
+        std::chrono::duration<double, std::milli> execute_diff = std::chrono::high_resolution_clock::now() - start;
+        double plan_time = prepare_time + execute_diff.count() - result.Duration();
 
-            auto mapping_finish = std::chrono::high_resolution_clock::now();
-            std::chrono::duration<double, std::milli> mapping_diff = mapping_finish - mapping_start;
+        auto mapping_start = std::chrono::high_resolution_clock::now();
+        for (const auto& row : result) {
+            for (const auto& value : row) {
+                std::cout << value << " ";
+            }
+            std::cout << "\n";
+        }
+        size_t cnt = result.Size();
 
-            auto finish = std::chrono::high_resolution_clock::now();
-            std::chrono::duration<double, std::milli> diff = finish - start;
+        auto mapping_finish = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::milli> mapping_diff = mapping_finish - mapping_start;
 
-            std::chrono::duration<double, std::milli> plan_time = plan_end - start;
+        auto finish = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::milli> diff = finish - start;
 
-            std::cout << cnt << " result(s).\n";
-            std::cout << "generate plan takes " << plan_time.count() << " ms.\n";
-            std::cout << "execute takes " << executor->Duration() << " ms.\n";
-            std::cout << "output result takes " << mapping_diff.count() << " ms.\n";
-            std::cout << "query cost " << diff.count() << " ms." << std::endl;
-            // printf("%s", sparql.c_str());
-        }
+        if (result.MemoryExceeded())
+            std::cout << "query aborted, it exceeds the memory limit of " << options.memory_limit << " MB.\n";
+        else if (result.TimedOut())
+            std::cout << "query timed out after " << options.timeout << " ms, the results are partial.\n";
+        else if (result.Cancelled())
+            std::cout << "query cancelled, the results are partial.\n";
+        std::cout << cnt << " result(s).\n";
+        std::cout << "generate plan takes " << plan_time << " ms.\n";
+        std::cout << "execute takes " << result.Duration() << " ms.\n";
+        std::cout << "output result takes " << mapping_diff.count() << " ms.\n";
+        std::cout << "query cost " << prepare_time + diff.count() << " ms.\n";
+        std::cout << "peak memory " << result.PeakMemory() / 1024.0 << " KB." << std::endl;
     }
 
-    void Query(const std::string& name, const std::string& file) {
+    // params_file 的每一行是一组用制表符分隔的参数
+    void Query(const std::string& name,
+               const std::string& file,
+               const epei::QueryOptions& options,
+               const epei::OpenOptions& open,
+               const std::string& params_file = "") {
         if (name != "" and file != "") {
-            std::shared_ptr<IndexRetriever> index = std::make_shared<IndexRetriever>(name);
-            std::ifstream in(file, std::ifstream::in);
-            std::vector<std::string> sparqls;
-            if (in.is_open()) {
-                std::string line;
-                std::string sparql;
-                while (std::getline(in, sparql)) {
-                    sparqls.push_back(sparql);
+            index_ = OpenIndex(name, open.load_policy);
+            plan_cache_->Clear();
+            plan_cache_->SetSamplingBudget(open.sampling_budget);
+            std::vector<std::vector<std::string>> parameters;
+            if (!params_file.empty()) {
+                if (!std::filesystem::exists(params_file))
+                    throw std::runtime_error("parameter file " + params_file + " doesn't exist");
+                for (const auto& line : ReadSparqls(params_file)) {
+                    std::vector<std::string> values;
+                    std::stringstream ss(line);
+                    std::string value;
+                    while (std::getline(ss, value, '\t')) {
+                        values.push_back(value);
+                    }
+                    parameters.push_back(std::move(values));
                 }
-                in.close();
             }
-            ExecuteSparql(sparqls, index);
-            exit(0);
+            ExecuteSparql(ReadSparqls(file), options, parameters);
         }
     }
 
-    void Server(const std::string& ip, const std::string& port, const std::string& db) {
-        start_server(ip, port, db);
+    // 使用 workers 个线程并发执行文件中的查询，output_dir 不为空时每个查询的结果写入 output_dir/<序号>.txt，
+    // 否则丢弃结果。最后输出每个查询的延迟和总的吞吐量
+    void Batch(const std::string& name,
+               const std::string& file,
+               uint workers,
+               const std::string& output_dir,
+               const epei::QueryOptions& options,
+               const epei::OpenOptions& open) {
+        index_ = OpenIndex(name, open.load_policy);
+        plan_cache_->Clear();
+        plan_cache_->SetSamplingBudget(open.sampling_budget);
+        std::vector<std::string> sparqls = ReadSparqls(file);
+        if (!output_dir.empty())
+            std::filesystem::create_directories(output_dir);
+
+        struct Report {
+            std::string status = "ok";
+            size_t cnt = 0;
+            double execute_time = 0;
+            double latency = 0;
+            size_t peak_memory = 0;
+        };
+        std::vector<Report> reports(sparqls.size());
+
+        auto start = std::chrono::high_resolution_clock::now();
+        {
+            BS::thread_pool pool(workers);
+            for (size_t i = 0; i < sparqls.size(); i++) {
+                pool.push_task([&, i]() {
+                    auto query_start = std::chrono::high_resolution_clock::now();
+                    Report& report = reports[i];
+                    try {
+                        epei::QueryResult result = epei::Statement(Prepare(sparqls[i])).Execute(options);
+                        if (!output_dir.empty()) {
+                            std::ofstream out(output_dir + "/" + std::to_string(i + 1) + ".txt");
+                            for (const auto& row : result) {
+                                for (const auto& value : row) {
+                                    out << value << " ";
+                                }
+                                out << "\n";
+                            }
+                        }
+                        report.cnt = result.Size();
+                        report.execute_time = result.Duration();
+                        report.peak_memory = result.PeakMemory();
+                        if (result.MemoryExceeded())
+                            report.status = "memory";
+                        else if (result.TimedOut())
+                            report.status = "timeout";
+                        else if (result.Cancelled())
+                            report.status = "cancelled";
+                    } catch (const std::exception& e) {
+                        report.status = "error";
+                    }
+                    std::chrono::duration<double, std::milli> latency =
+                        std::chrono::high_resolution_clock::now() - query_start;
+                    report.latency = latency.count();
+                });
+            }
+            pool.wait_for_tasks();
+        }
+        std::chrono::duration<double, std::milli> wall = std::chrono::high_resolution_clock::now() - start;
+
+        std::cout << "query\tstatus\tresults\texecute(ms)\tlatency(ms)\tpeak memory(KB)\n";
+        std::vector<double> latencies;
+        for (size_t i = 0; i < reports.size(); i++) {
+            const auto& report = reports[i];
+            std::cout << i + 1 << "\t" << report.status << "\t" << report.cnt << "\t" << report.execute_time << "\t"
+                      << report.latency << "\t" << report.peak_memory / 1024.0 << "\n";
+            latencies.push_back(report.latency);
+        }
+
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&](double p) {
+            return latencies.empty() ? 0 : latencies[std::min(latencies.size() - 1, size_t(p * latencies.size()))];
+        };
+        double total = 0;
+        for (double latency : latencies) {
+            total += latency;
+        }
+        std::cout << sparqls.size() << " queries on " << workers << " worker(s) take " << wall.count() << " ms, "
+                  << (wall.count() > 0 ? sparqls.size() * 1000.0 / wall.count() : 0) << " queries/s.\n";
+        std::cout << "latency avg " << (latencies.empty() ? 0 : total / latencies.size()) << " ms, p50 "
+                  << percentile(0.5) << " ms, p95 " << percentile(0.95) << " ms, p99 " << percentile(0.99)
+                  << " ms, max " << (latencies.empty() ? 0 : latencies.back()) << " ms." << std::endl;
+    }
+
+    void Server(const std::string& ip,
+                const std::string& port,
+                const std::string& db,
+                const epei::QueryOptions& options,
+                const epei::OpenOptions& open,
+                uint result_cache) {
+        start_server(ip, port, db, options.timeout, options.memory_limit, result_cache, open.sampling_budget,
+                     LoadPolicies(open.load_policy));
+    }
+
+    // 修改后清空缓存的计划，让之后的查询按新的设置重新生成计划
+    void SetSamplingBudget(uint microseconds) {
+        plan_cache_->SetSamplingBudget(microseconds);
+        plan_cache_->Clear();
     }
 
    private:
@@ -129,6 +409,35 @@ class epei::Engine::Impl {
         std::cout << "\nExample:" << std::endl;
         std::cout << "  select database_name\n" << std::endl;
     }
+
+    static std::vector<std::string> ReadSparqls(const std::string& file) {
+        std::ifstream in(file, std::ifstream::in);
+        std::vector<std::string> sparqls;
+        if (in.is_open()) {
+            std::string sparql;
+            while (std::getline(in, sparql)) {
+                sparqls.push_back(sparql);
+            }
+            in.close();
+        }
+        return sparqls;
+    }
+
+    // 最后一个引用数据库的对象释放时关闭映射的文件
+    static std::shared_ptr<IndexRetriever> OpenIndex(const std::string& db_name, const std::string& load_policy) {
+        LoadPolicies load_policies(load_policy);
+        if (!std::filesystem::is_directory("./DB_DATA_ARCHIVE/" + db_name))
+            throw std::runtime_error("database " + db_name + " doesn't exist");
+        return std::shared_ptr<IndexRetriever>(new IndexRetriever(db_name, load_policies), [](IndexRetriever* index) {
+            index->close();
+            delete index;
+        });
+    }
+
+    std::shared_ptr<IndexRetriever> index_;
+    std::shared_ptr<PlanCache> plan_cache_ = std::make_shared<PlanCache>();
+    // 引擎上所有查询共享的线程池，执行 UNION 的分支和聚合
+    std::shared_ptr<BS::thread_pool> thread_pool_ = std::make_shared<BS::thread_pool>();
 };
 
 #endif  // ENGINE_IMPL_HPP
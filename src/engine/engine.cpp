@@ -15,14 +15,97 @@ void Engine::Create(const std::string& db_name, const std::string& data_file) {
     impl->Create(db_name, data_file);
 }
 
-void Engine::Query(const std::string& db_name, const std::string& data_file) {
+void Engine::Query(const std::string& db_name,
+                   const std::string& data_file,
+                   const QueryOptions& options,
+                   const OpenOptions& open,
+                   const std::string& params_file) {
     auto impl = std::make_shared<Engine::Impl>();
-    impl->Query(db_name, data_file);
+    impl->Query(db_name, data_file, options, open, params_file);
 }
 
-void Engine::Server(const std::string& ip, const std::string& port, const std::string& db) {
+void Engine::Batch(const std::string& db_name,
+                   const std::string& data_file,
+                   uint32_t workers,
+                   const std::string& output_dir,
+                   const QueryOptions& options,
+                   const OpenOptions& open) {
     auto impl = std::make_shared<Engine::Impl>();
-    impl->Server(ip, port, db);
+    impl->Batch(db_name, data_file, workers, output_dir, options, open);
+}
+
+void Engine::Server(const std::string& ip,
+                    const std::string& port,
+                    const std::string& db,
+                    const QueryOptions& options,
+                    const OpenOptions& open,
+                    uint32_t result_cache) {
+    auto impl = std::make_shared<Engine::Impl>();
+    impl->Server(ip, port, db, options, open, result_cache);
+}
+
+Engine Engine::Open(const std::string& db_name, const OpenOptions& open) {
+    return Engine(std::make_shared<Engine::Impl>(db_name, open));
+}
+
+Statement Engine::Prepare(const std::string& sparql) const {
+    return Statement(_impl->Prepare(sparql));
+}
+
+QueryResult Engine::Execute(const std::string& sparql, const QueryOptions& options) const {
+    return Prepare(sparql).Execute(options);
+}
+
+void Engine::SetSamplingBudget(uint32_t microseconds) const {
+    _impl->SetSamplingBudget(microseconds);
+}
+
+const std::vector<std::string>& Statement::Variables() const {
+    return _impl->Variables();
+}
+
+const std::vector<std::string>& Statement::Parameters() const {
+    return _impl->Parameters();
+}
+
+QueryResult Statement::Execute(const QueryOptions& options) const {
+    return QueryResult(_impl->Execute({}, options));
+}
+
+QueryResult Statement::Execute(const std::vector<std::string>& parameters, const QueryOptions& options) const {
+    return QueryResult(_impl->Execute(parameters, options));
+}
+
+const std::vector<std::string>& QueryResult::Variables() const {
+    return _impl->variables_;
+}
+
+size_t QueryResult::Size() const {
+    return _impl->Size();
+}
+
+std::vector<std::string> QueryResult::Row(size_t i) const {
+    return _impl->Row(i);
+}
+
+bool QueryResult::TimedOut() const {
+    return _impl->guard_->TimedOut();
+}
+
+bool QueryResult::Cancelled() const {
+    return _impl->guard_->Cancelled();
+}
+
+bool QueryResult::MemoryExceeded() const {
+    return _impl->guard_->MemoryExceeded();
+}
+
+double QueryResult::Duration() const {
+    return _impl->duration_;
+}
+
+size_t QueryResult::PeakMemory() const {
+    return _impl->guard_->PeakMemory();
 }
 
 }  // namespace epei
@@ -41,7 +41,8 @@ class SPARQLLexer {
         kLess,
         kLessOrEq,
         kGreater,
-        kGreaterOrEq
+        kGreaterOrEq,
+        kParameter
     };
 
    public:
@@ -168,6 +169,13 @@ class SPARQLLexer {
                     }
                     token_stop_pos_ = current_pos_;
                     return TokenT::kVariable;
+                case '$':
+                    // 预编译查询的参数，执行时绑定为具体的常量
+                    while (HasNext() && IsLegalIdentifierCharacter(*current_pos_)) {
+                        ++current_pos_;
+                    }
+                    token_stop_pos_ = current_pos_;
+                    return TokenT::kParameter;
                 case '0':
                 case '1':
                 case '2':
@@ -9,7 +9,9 @@
 #ifndef SPARQL_PARSER_HPP
 #define SPARQL_PARSER_HPP
 
+#include <algorithm>
 #include <exception>
+#include <iterator>
 #include <set>
 #include <sstream>
 #include <string>
@@ -34,7 +36,7 @@ class SPARQLParser {
     };
 
     struct TriplePatternElem {
-        enum Type { Variable, IRI, Literal, Blank };
+        enum Type { Variable, IRI, Literal, Blank, Parameter };
         enum LiteralType { Integer, Double, String, Function, None };
 
         TriplePatternElem() : type_(Type::Blank), literal_type_(LiteralType::None), value_() {}
@@ -80,6 +82,15 @@ class SPARQLParser {
         std::vector<TriplePatternElem> filter_args_;
     };
 
+    // (COUNT(?x) AS ?c)
+    struct Aggregate {
+        enum Type { Count, Sum, Min, Max, Avg };
+        Type aggregate_type_;
+        std::string variable_;  // "*" for COUNT(*)
+        std::string alias_;
+        bool distinct_;
+    };
+
     struct ProjectModifier {
         enum Type { None, Distinct, Reduced, Count, Duplicates };
 
@@ -106,12 +117,16 @@ class SPARQLParser {
 
    public:
     explicit SPARQLParser(const SPARQLLexer& sparql_lexer)
-        : limit_(UINTMAX_MAX), sparql_lexer_(sparql_lexer), project_modifier_(ProjectModifier::Type::None) {
+        : limit_(UINTMAX_MAX),
+          offset_(0),
+          sparql_lexer_(sparql_lexer),
+          project_modifier_(ProjectModifier::Type::None) {
         parse();
     }
 
     explicit SPARQLParser(std::string input_string)
         : limit_(UINTMAX_MAX),
+          offset_(0),
           sparql_lexer_(SPARQLLexer(std::move(input_string))),
           project_modifier_(ProjectModifier::Type::None) {
         parse();
@@ -133,34 +148,120 @@ class SPARQLParser {
         return list;
     }
 
+    bool HasUnion() const { return !union_patterns_.empty(); }
+
+    const std::vector<std::vector<std::vector<TriplePattern>>>& UnionPatterns() const { return union_patterns_; }
+
+    // 每一个 UNION 分支与 UNION 之外的三元组组成一个可选的查询，
+    // 多个 UNION 组之间取笛卡尔积
+    std::vector<std::vector<std::vector<std::string>>> TripleLists() const {
+        std::vector<std::vector<std::vector<std::string>>> lists = {TripleList()};
+        for (const auto& branches : union_patterns_) {
+            std::vector<std::vector<std::vector<std::string>>> expanded;
+            for (const auto& list : lists) {
+                for (const auto& branch : branches) {
+                    auto alternative = list;
+                    for (const auto& item : branch) {
+                        alternative.push_back({item.subj_.value_, item.pred_.value_, item.obj_.value_});
+                    }
+                    expanded.push_back(std::move(alternative));
+                }
+            }
+            lists.swap(expanded);
+        }
+        return lists;
+    }
+
     const std::unordered_map<std::string, Filter>& Filters() const { return filters_; }
 
     const std::unordered_map<std::string, std::string>& Prefixes() const { return prefixes_; }
 
     size_t Limit() const { return limit_; }
 
+    size_t Offset() const { return offset_; }
+
+    // (variable, is descending)
+    const std::vector<std::pair<std::string, bool>>& OrderBy() const { return order_by_; }
+
+    bool HasAggregate() const { return !aggregates_.empty() || !group_by_.empty(); }
+
+    const std::vector<Aggregate>& Aggregates() const { return aggregates_; }
+
+    const std::vector<std::string>& GroupBy() const { return group_by_; }
+
+    // 按照第一次出现的顺序排列的参数，例如 $name
+    const std::vector<std::string>& Parameters() const { return parameters_; }
+
+    // 把参数依次替换为 values 中的常量，常量的写法与查询中的相同，例如 <http://a>、"abc"、42
+    void Bind(const std::vector<std::string>& values) {
+        if (values.size() != parameters_.size()) {
+            throw ParserException("Expect " + std::to_string(parameters_.size()) + " parameter(s), but got " +
+                                  std::to_string(values.size()));
+        }
+        std::unordered_map<std::string, TriplePatternElem> constants;
+        for (size_t i = 0; i < values.size(); i++) {
+            constants[parameters_[i]] = MakeConstant(values[i]);
+        }
+        auto bind = [&](std::vector<TriplePattern>& patterns) {
+            for (auto& item : patterns) {
+                for (TPElem* elem : {&item.subj_, &item.pred_, &item.obj_}) {
+                    if (elem->type_ == TPElem::Type::Parameter)
+                        *elem = constants.at(elem->value_);
+                }
+            }
+        };
+        bind(triple_patterns_);
+        for (auto& branches : union_patterns_) {
+            for (auto& branch : branches) {
+                bind(branch);
+            }
+        }
+        parameters_.clear();
+    }
+
    private:
     void parse() {
         ParsePrefix();
         ParseProjection();
         ParseWhere();
         ParseGroupGraphPattern();
-        ParseLimit();
+        ParseGroupBy();
+        ParseOrderBy();
+        ParseLimitOffset();
+
+        // 有聚合时，投影的变量只能是聚合的结果或者 GROUP BY 的变量
+        if (HasAggregate()) {
+            for (const auto& var : project_variables_) {
+                bool is_alias = std::any_of(aggregates_.begin(), aggregates_.end(),
+                                            [&](const Aggregate& a) { return a.alias_ == var; });
+                if (!is_alias && std::find(group_by_.begin(), group_by_.end(), var) == group_by_.end()) {
+                    throw ParserException("Variable " + var + " is not in GROUP BY");
+                }
+            }
+        }
 
         // 如果 select 后是 *，则查询结果的变量应该是三元组中出现的变量
         if (project_variables_[0] == "*") {
             project_variables_.clear();
             std::set<std::string> variables_set;
-            for (const auto& item : triple_patterns_) {
-                const auto& s = item.subj_.value_;
-                const auto& p = item.pred_.value_;
-                const auto& o = item.obj_.value_;
-                if (s[0] == '?')
-                    variables_set.insert(s);
-                if (p[0] == '?')
-                    variables_set.insert(p);
-                if (o[0] == '?')
-                    variables_set.insert(o);
+            auto collect = [&](const std::vector<TriplePattern>& patterns) {
+                for (const auto& item : patterns) {
+                    const auto& s = item.subj_.value_;
+                    const auto& p = item.pred_.value_;
+                    const auto& o = item.obj_.value_;
+                    if (s[0] == '?')
+                        variables_set.insert(s);
+                    if (p[0] == '?')
+                        variables_set.insert(p);
+                    if (o[0] == '?')
+                        variables_set.insert(o);
+                }
+            };
+            collect(triple_patterns_);
+            for (const auto& branches : union_patterns_) {
+                for (const auto& branch : branches) {
+                    collect(branch);
+                }
             }
             project_variables_.assign(variables_set.begin(), variables_set.end());
         }
@@ -217,6 +318,10 @@ class SPARQLParser {
         project_variables_.clear();
         do {
             token_t = sparql_lexer_.GetNextTokenType();
+            if (token_t == SPARQLLexer::TokenT::kLRound) {
+                ParseAggregate();
+                continue;
+            }
             if (token_t != SPARQLLexer::TokenT::kVariable) {
                 sparql_lexer_.PutBack(token_t);
                 break;
@@ -229,6 +334,60 @@ class SPARQLParser {
         }
     }
 
+    // '(' 之后的部分：COUNT([DISTINCT] ?x | *) AS ?alias)
+    void ParseAggregate() {
+        Aggregate aggregate;
+        if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::TokenT::kIdentifier) {
+            throw ParserException("Expect : aggregate function");
+        }
+        if (sparql_lexer_.IsKeyword("count"))
+            aggregate.aggregate_type_ = Aggregate::Type::Count;
+        else if (sparql_lexer_.IsKeyword("sum"))
+            aggregate.aggregate_type_ = Aggregate::Type::Sum;
+        else if (sparql_lexer_.IsKeyword("min"))
+            aggregate.aggregate_type_ = Aggregate::Type::Min;
+        else if (sparql_lexer_.IsKeyword("max"))
+            aggregate.aggregate_type_ = Aggregate::Type::Max;
+        else if (sparql_lexer_.IsKeyword("avg"))
+            aggregate.aggregate_type_ = Aggregate::Type::Avg;
+        else
+            throw ParserException("Unsupported aggregate function " + sparql_lexer_.GetCurrentTokenValue());
+
+        if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::TokenT::kLRound) {
+            throw ParserException("Expect : (");
+        }
+        auto token_t = sparql_lexer_.GetNextTokenType();
+        aggregate.distinct_ = token_t == SPARQLLexer::TokenT::kIdentifier && sparql_lexer_.IsKeyword("distinct");
+        if (aggregate.distinct_)
+            token_t = sparql_lexer_.GetNextTokenType();
+        if (token_t != SPARQLLexer::TokenT::kVariable) {
+            throw ParserException("Expect : Variable");
+        }
+        aggregate.variable_ = sparql_lexer_.GetCurrentTokenValue();
+        if (aggregate.variable_ == "*" &&
+            (aggregate.aggregate_type_ != Aggregate::Type::Count || aggregate.distinct_)) {
+            throw ParserException("Only COUNT(*) accepts '*'");
+        }
+        if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::TokenT::kRRound) {
+            throw ParserException("Expect : )");
+        }
+
+        token_t = sparql_lexer_.GetNextTokenType();
+        if (token_t != SPARQLLexer::TokenT::kIdentifier || !sparql_lexer_.IsKeyword("as")) {
+            throw ParserException("Expect : AS");
+        }
+        if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::TokenT::kVariable) {
+            throw ParserException("Expect : Variable");
+        }
+        aggregate.alias_ = sparql_lexer_.GetCurrentTokenValue();
+        if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::TokenT::kRRound) {
+            throw ParserException("Expect : )");
+        }
+
+        project_variables_.push_back(aggregate.alias_);
+        aggregates_.push_back(std::move(aggregate));
+    }
+
     void ParseWhere() {
         if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::TokenT::kIdentifier ||
             !sparql_lexer_.IsKeyword("where")) {
@@ -309,7 +468,9 @@ class SPARQLParser {
             auto token_t = sparql_lexer_.GetNextTokenType();
             if (token_t == SPARQLLexer::TokenT::kLCurly) {
                 sparql_lexer_.PutBack(token_t);
+                size_t branch_begin = triple_patterns_.size();
                 ParseGroupGraphPattern();
+                ParseUnion(branch_begin);
             } else if (token_t == SPARQLLexer::TokenT::kIdentifier && sparql_lexer_.IsKeyword("optional") &&
                        sparql_lexer_.IsKeyword("OPTIONAL")) {
                 if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::TokenT::kLCurly) {
@@ -333,6 +494,41 @@ class SPARQLParser {
         }
     }
 
+    // { ... } UNION { ... } UNION ...
+    // 第一个分支已经被解析到 triple_patterns_ 的 [branch_begin, end) 中
+    void ParseUnion(size_t branch_begin) {
+        auto token_t = sparql_lexer_.GetNextTokenType();
+        if (token_t != SPARQLLexer::TokenT::kIdentifier || !sparql_lexer_.IsKeyword("union")) {
+            sparql_lexer_.PutBack(token_t);
+            return;
+        }
+
+        size_t union_cnt = union_patterns_.size();
+        std::vector<std::vector<TriplePattern>> branches;
+        auto take_branch = [&]() {
+            if (union_patterns_.size() != union_cnt) {
+                throw ParserException("Nested UNION is not supported");
+            }
+            branches.emplace_back(std::make_move_iterator(triple_patterns_.begin() + branch_begin),
+                                  std::make_move_iterator(triple_patterns_.end()));
+            triple_patterns_.erase(triple_patterns_.begin() + branch_begin, triple_patterns_.end());
+        };
+
+        take_branch();
+        do {
+            if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::TokenT::kLCurly) {
+                throw ParserException("Except : '{'");
+            }
+            sparql_lexer_.PutBack(SPARQLLexer::TokenT::kLCurly);
+            ParseGroupGraphPattern();
+            take_branch();
+            token_t = sparql_lexer_.GetNextTokenType();
+        } while (token_t == SPARQLLexer::TokenT::kIdentifier && sparql_lexer_.IsKeyword("union"));
+        sparql_lexer_.PutBack(token_t);
+
+        union_patterns_.push_back(std::move(branches));
+    }
+
     void ParseBasicGraphPattern(bool is_option) {
         TriplePatternElem pattern_elem[3];
         for (int i = 0; i < 3; ++i) {
@@ -355,6 +551,11 @@ class SPARQLParser {
                 case SPARQLLexer::TokenT::kIdentifier:
                     elem = MakeNoTypeLiteral(token_value);
                     break;
+                case SPARQLLexer::TokenT::kParameter:
+                    elem = MakeParameter(token_value);
+                    if (std::find(parameters_.begin(), parameters_.end(), token_value) == parameters_.end())
+                        parameters_.push_back(token_value);
+                    break;
                 default:
                     throw ParserException("Except variable or IRI or Literal or Blank");
             }
@@ -368,20 +569,96 @@ class SPARQLParser {
         triple_patterns_.push_back(std::move(pattern));
     }
 
-    void ParseLimit() {
+    // GROUP BY ?a ?b
+    void ParseGroupBy() {
         auto token_t = sparql_lexer_.GetNextTokenType();
-        if (token_t == SPARQLLexer::kIdentifier && sparql_lexer_.IsKeyword("limit")) {
-            if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::kNumber) {
-                throw ParserException("Except : limit number");
+        if (token_t != SPARQLLexer::kIdentifier || !sparql_lexer_.IsKeyword("group")) {
+            sparql_lexer_.PutBack(token_t);
+            return;
+        }
+        if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::kIdentifier || !sparql_lexer_.IsKeyword("by")) {
+            throw ParserException("Except : 'by'");
+        }
+
+        for (;;) {
+            token_t = sparql_lexer_.GetNextTokenType();
+            if (token_t != SPARQLLexer::kVariable) {
+                sparql_lexer_.PutBack(token_t);
+                break;
             }
-            std::string curr_number_token = sparql_lexer_.GetCurrentTokenValue();
-            std::stringstream ss(curr_number_token);
-            ss >> limit_;
-        } else {
+            group_by_.push_back(sparql_lexer_.GetCurrentTokenValue());
+        }
+
+        if (group_by_.empty()) {
+            throw ParserException("group by variables is empty");
+        }
+    }
+
+    // ORDER BY ?a DESC(?b) ASC(?c)
+    void ParseOrderBy() {
+        auto token_t = sparql_lexer_.GetNextTokenType();
+        if (token_t != SPARQLLexer::kIdentifier || !sparql_lexer_.IsKeyword("order")) {
             sparql_lexer_.PutBack(token_t);
+            return;
+        }
+        if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::kIdentifier || !sparql_lexer_.IsKeyword("by")) {
+            throw ParserException("Except : 'by'");
+        }
+
+        for (;;) {
+            token_t = sparql_lexer_.GetNextTokenType();
+            if (token_t == SPARQLLexer::kVariable) {
+                order_by_.emplace_back(sparql_lexer_.GetCurrentTokenValue(), false);
+            } else if (token_t == SPARQLLexer::kIdentifier &&
+                       (sparql_lexer_.IsKeyword("asc") || sparql_lexer_.IsKeyword("desc"))) {
+                bool descending = sparql_lexer_.IsKeyword("desc");
+                if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::kLRound) {
+                    throw ParserException("Expect : (");
+                }
+                if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::kVariable) {
+                    throw ParserException("Expect : Variable");
+                }
+                order_by_.emplace_back(sparql_lexer_.GetCurrentTokenValue(), descending);
+                if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::kRRound) {
+                    throw ParserException("Expect : )");
+                }
+            } else {
+                sparql_lexer_.PutBack(token_t);
+                break;
+            }
+        }
+
+        if (order_by_.empty()) {
+            throw ParserException("order by variables is empty");
         }
     }
 
+    // LIMIT 和 OFFSET 的顺序任意
+    void ParseLimitOffset() {
+        for (int i = 0; i < 2; i++) {
+            auto token_t = sparql_lexer_.GetNextTokenType();
+            if (token_t == SPARQLLexer::kIdentifier && sparql_lexer_.IsKeyword("limit")) {
+                limit_ = ParseNumber("Except : limit number");
+            } else if (token_t == SPARQLLexer::kIdentifier && sparql_lexer_.IsKeyword("offset")) {
+                offset_ = ParseNumber("Except : offset number");
+            } else {
+                sparql_lexer_.PutBack(token_t);
+                return;
+            }
+        }
+    }
+
+    size_t ParseNumber(const char* message) {
+        if (sparql_lexer_.GetNextTokenType() != SPARQLLexer::kNumber) {
+            throw ParserException(message);
+        }
+        size_t number;
+        std::string curr_number_token = sparql_lexer_.GetCurrentTokenValue();
+        std::stringstream ss(curr_number_token);
+        ss >> number;
+        return number;
+    }
+
     TriplePatternElem MakeVariable(std::string variable) {
         return {TPElem::Type::Variable, TPElem::LiteralType::None, std::move(variable)};
     }
@@ -415,13 +692,44 @@ class SPARQLParser {
         return {TPElem::Type::Literal, TPElem::LiteralType::Function, std::move(literal)};
     }
 
+    TriplePatternElem MakeParameter(std::string parameter) {
+        return {TPElem::Type::Parameter, TPElem::LiteralType::None, std::move(parameter)};
+    }
+
+    // 参数的值必须是一个完整的 IRI 或字面量
+    TriplePatternElem MakeConstant(const std::string& value) {
+        SPARQLLexer lexer(value);
+        auto token_t = lexer.GetNextTokenType();
+        if (value.empty() || lexer.GetCurrentTokenValue() != value)
+            throw ParserException("Illegal parameter value: " + value);
+        switch (token_t) {
+            case SPARQLLexer::TokenT::kIRI:
+                return MakeIRI(value);
+            case SPARQLLexer::TokenT::kString:
+                return MakeStringLiteral(value);
+            case SPARQLLexer::TokenT::kNumber:
+                return MakeDoubleLiteral(value);
+            case SPARQLLexer::TokenT::kIdentifier:
+                return MakeNoTypeLiteral(value);
+            default:
+                throw ParserException("Illegal parameter value: " + value);
+        }
+    }
+
    private:
-    size_t limit_;  // limit number
+    size_t limit_;   // limit number
+    size_t offset_;  // offset number
     SPARQLLexer sparql_lexer_;
     ProjectModifier project_modifier_;            // modifier
     std::vector<std::string> project_variables_;  // all variables to be outputted
     std::vector<TriplePattern> triple_patterns_;  // all triple patterns
+    // UNION groups -> branches -> triple patterns of each branch
+    std::vector<std::vector<std::vector<TriplePattern>>> union_patterns_;
     std::unordered_map<std::string, Filter> filters_;
+    std::vector<std::pair<std::string, bool>> order_by_;  // (variable, is descending)
+    std::vector<Aggregate> aggregates_;
+    std::vector<std::string> group_by_;
+    std::vector<std::string> parameters_;
     std::unordered_map<std::string, std::string> prefixes_;  // the registered prefixes
 };
 
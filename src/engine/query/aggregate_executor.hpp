@@ -0,0 +1,184 @@
+#ifndef AGGREGATE_EXECUTOR_HPP
+#define AGGREGATE_EXECUTOR_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../parser/sparql_parser.hpp"
+#include "../store/index_retriever.hpp"
+#include "../tools/thread_pool.hpp"
+#include "aggregation.hpp"
+#include "order_by.hpp"
+#include "plan_cache.hpp"
+#include "query_executor.hpp"
+#include "query_guard.hpp"
+#include "query_plan.hpp"
+
+// 执行带有 GROUP BY 或聚合函数的查询。
+// 每个（UNION 分支，第 0 层候选结果的一份）由一个线程执行，结果直接在线程自己的 HashAggregation 中预聚合，
+// 之后按 partition 并行合并，最后在字符串结果上处理 ORDER BY、OFFSET 和 LIMIT
+class AggregateExecutor {
+   public:
+    AggregateExecutor(const std::shared_ptr<IndexRetriever>& p_index,
+                      const std::shared_ptr<SPARQLParser>& p_parser)
+        : _p_index(p_index), _p_parser(p_parser) {}
+
+    void Query() {
+        _query_begin_time = std::chrono::high_resolution_clock::now();
+
+        const auto& group_by = _p_parser->GroupBy();
+        const auto& aggregates = _p_parser->Aggregates();
+
+        std::vector<std::shared_ptr<QueryPlan>> plans;
+        for (const auto& triple_list : _p_parser->TripleLists()) {
+            if (_plan_cache)
+                plans.push_back(_plan_cache->Get(_p_index, triple_list, UINTMAX_MAX));
+            else
+                plans.push_back(std::make_shared<QueryPlan>(_p_index, triple_list, UINTMAX_MAX));
+        }
+
+        size_t thread_cnt = _thread_pool ? std::max<size_t>(1, _thread_pool->get_thread_count()) : 1;
+        size_t part_cnt = std::max<size_t>(1, thread_cnt / plans.size());
+
+        std::vector<std::unique_ptr<HashAggregation>> partials;
+        for (size_t i = 0; i < plans.size() * part_cnt; i++) {
+            partials.push_back(std::make_unique<HashAggregation>(_p_index, group_by, aggregates, thread_cnt));
+            partials.back()->Bind(plans[i / part_cnt]);
+        }
+
+        BS::multi_future<void> futures;
+        for (size_t i = 0; i < partials.size(); i++) {
+            futures.push_back(Submit([&, i]() {
+                HashAggregation* partial = partials[i].get();
+                QueryExecutor executor(_p_index, plans[i / part_cnt]);
+                executor.SetPartition(i % part_cnt, part_cnt);
+                executor.SetGuard(_guard);
+                // 分组占用的内存每增加 kTrackBytes 记录一次
+                size_t tracked = 0;
+                executor.SetTupleSink([&, partial](const std::vector<uint>& tuple) {
+                    partial->Consume(tuple);
+                    if (_guard && partial->memory() - tracked >= QueryGuard::kTrackBytes) {
+                        _guard->AddMemory(partial->memory() - tracked);
+                        tracked = partial->memory();
+                    }
+                });
+                executor.Query();
+                if (_guard)
+                    _guard->AddMemory(partial->memory() - tracked);
+            }));
+        }
+        futures.get();
+
+        if (_guard && _guard->MemoryExceeded()) {
+            _query_end_time = std::chrono::high_resolution_clock::now();
+            return;
+        }
+
+        HashAggregation aggregation(_p_index, group_by, aggregates, thread_cnt);
+        BS::multi_future<void> merge_futures;
+        for (size_t partition = 0; partition < aggregation.partition_cnt(); partition++) {
+            merge_futures.push_back(Submit([&, partition]() {
+                for (auto& partial : partials) {
+                    aggregation.Merge(*partial, partition);
+                }
+            }));
+        }
+        merge_futures.get();
+
+        _result = aggregation.Finish(_p_parser->ProjectVariables(), GroupPositions(plans));
+
+        Sort();
+
+        _query_end_time = std::chrono::high_resolution_clock::now();
+    }
+
+    // 查询被停止时，聚合的是停止前得到的结果
+    void SetGuard(const std::shared_ptr<QueryGuard>& guard) { _guard = guard; }
+
+    // 分支的查询计划从 plan_cache 中获取
+    void SetPlanCache(const std::shared_ptr<PlanCache>& plan_cache) { _plan_cache = plan_cache; }
+
+    // 预聚合和合并在共享的线程池中执行，没有设置时依次执行
+    void SetThreadPool(const std::shared_ptr<BS::thread_pool>& thread_pool) { _thread_pool = thread_pool; }
+
+    bool Stopped() const { return _guard && _guard->Stopped(); }
+
+    inline double Duration() {
+        return static_cast<std::chrono::duration<double, std::milli>>(_query_end_time - _query_begin_time)
+            .count();
+    }
+
+    // 每一行按照 ProjectVariables 的顺序排列
+    [[nodiscard]] std::vector<std::vector<std::string>>& query_result() { return _result; }
+
+   private:
+    template <typename F>
+    std::future<void> Submit(F&& task) {
+        if (_thread_pool)
+            return _thread_pool->submit(std::forward<F>(task));
+        std::promise<void> done;
+        task();
+        done.set_value();
+        return done.get_future();
+    }
+
+    std::vector<Pos> GroupPositions(const std::vector<std::shared_ptr<QueryPlan>>& plans) {
+        std::vector<Pos> positions;
+        for (const auto& var : _p_parser->GroupBy()) {
+            Pos pos = Pos::kSubject;
+            for (const auto& plan : plans) {
+                auto it = plan->variable_metadata().find(var);
+                if (it != plan->variable_metadata().end()) {
+                    pos = it->second.second;
+                    break;
+                }
+            }
+            positions.push_back(pos);
+        }
+        return positions;
+    }
+
+    void Sort() {
+        const auto& variables = _p_parser->ProjectVariables();
+        std::vector<std::pair<size_t, bool>> columns;
+        for (const auto& [variable, descending] : _p_parser->OrderBy()) {
+            auto it = std::find(variables.begin(), variables.end(), variable);
+            if (it != variables.end())
+                columns.emplace_back(it - variables.begin(), descending);
+        }
+
+        if (!columns.empty()) {
+            std::stable_sort(_result.begin(), _result.end(),
+                             [&](const std::vector<std::string>& a, const std::vector<std::string>& b) {
+                                 for (const auto& [column, descending] : columns) {
+                                     int cmp = OrderBy::CompareTerms(a[column], b[column]);
+                                     if (cmp != 0)
+                                         return descending ? cmp > 0 : cmp < 0;
+                                 }
+                                 return false;
+                             });
+        }
+
+        size_t offset = std::min(_p_parser->Offset(), _result.size());
+        _result.erase(_result.begin(), _result.begin() + offset);
+        if (_result.size() > _p_parser->Limit())
+            _result.resize(_p_parser->Limit());
+    }
+
+   private:
+    std::shared_ptr<IndexRetriever> _p_index;
+    std::shared_ptr<SPARQLParser> _p_parser;
+
+    std::vector<std::vector<std::string>> _result;
+    std::shared_ptr<QueryGuard> _guard;
+    std::shared_ptr<PlanCache> _plan_cache;
+    std::shared_ptr<BS::thread_pool> _thread_pool;
+
+    std::chrono::system_clock::time_point _query_begin_time, _query_end_time;
+};
+
+#endif  // AGGREGATE_EXECUTOR_HPP
@@ -0,0 +1,257 @@
+#ifndef AGGREGATION_HPP
+#define AGGREGATION_HPP
+
+#include <parallel_hashmap/phmap.h>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../parser/sparql_parser.hpp"
+#include "../store/index_retriever.hpp"
+#include "order_by.hpp"
+#include "query_plan.hpp"
+
+// GROUP BY 的哈希聚合，直接处理执行器产生的 id 元组，
+// 只在输出时解码分组的 key，只对 SUM/AVG/MIN/MAX 的值解码，解码结果按 partition 缓存在 OrderBy 中。
+// 每个线程使用自己的 HashAggregation 做预聚合，分组按哈希值划分到不同的 partition 中，
+// 最后各个 partition 可以并行地合并
+class HashAggregation {
+   public:
+    using Aggregate = SPARQLParser::Aggregate;
+
+    struct State {
+        uint64_t count_ = 0;
+        uint64_t numeric_cnt_ = 0;
+        double sum_ = 0;
+        uint min_ = 0;
+        uint max_ = 0;
+        phmap::flat_hash_set<uint> seen_;  // for DISTINCT
+    };
+
+    struct KeyHash {
+        size_t operator()(const std::vector<uint>& key) const {
+            size_t h = key.size();
+            for (uint v : key) {
+                h ^= v + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+            }
+            return h;
+        }
+    };
+
+    using Groups = phmap::flat_hash_map<std::vector<uint>, std::vector<State>, KeyHash>;
+
+    HashAggregation(const std::shared_ptr<IndexRetriever>& index,
+                    const std::vector<std::string>& group_by,
+                    const std::vector<Aggregate>& aggregates,
+                    size_t partition_cnt)
+        : index_(index),
+          group_by_(group_by),
+          aggregates_(aggregates),
+          partitions_(partition_cnt) {
+        values_.reserve(partition_cnt);
+        for (size_t i = 0; i < partition_cnt; i++) {
+            values_.emplace_back(index, std::vector<OrderBy::Column>());
+        }
+    }
+
+    // 根据查询计划确定分组变量和聚合变量在元组中的位置，-1 表示没有这个变量
+    void Bind(const std::shared_ptr<QueryPlan>& plan) {
+        const auto& metadata = plan->variable_metadata();
+        auto column = [&](const std::string& var) {
+            auto it = metadata.find(var);
+            return it == metadata.end() ? -1 : int(it->second.first);
+        };
+        group_columns_.clear();
+        aggregate_columns_.clear();
+        for (const auto& var : group_by_) {
+            group_columns_.push_back(column(var));
+        }
+        for (const auto& aggregate : aggregates_) {
+            aggregate_columns_.push_back(column(aggregate.variable_));
+        }
+    }
+
+    void Consume(const std::vector<uint>& tuple) {
+        std::vector<uint> key(group_columns_.size(), 0);
+        for (size_t i = 0; i < group_columns_.size(); i++) {
+            if (group_columns_[i] != -1)
+                key[i] = tuple[group_columns_[i]];
+        }
+
+        size_t partition = PartitionOf(key);
+        auto& states = Find(partition, key);
+        for (size_t i = 0; i < aggregates_.size(); i++) {
+            uint id = aggregate_columns_[i] == -1 ? 0 : tuple[aggregate_columns_[i]];
+            if (aggregates_[i].variable_ == "*") {
+                states[i].count_++;
+                continue;
+            }
+            if (id == 0)
+                continue;
+            if (aggregates_[i].distinct_) {
+                if (!states[i].seen_.insert(id).second)
+                    continue;
+                memory_ += sizeof(uint);
+            }
+            Update(partition, aggregates_[i], states[i], id);
+        }
+    }
+
+    size_t partition_cnt() const { return partitions_.size(); }
+
+    // 分组和 DISTINCT 集合占用的内存（估计值，字节）
+    size_t memory() const { return memory_; }
+
+    // 将 other 中第 partition 个 partition 合并进来，不同的 partition 可以并行合并
+    void Merge(HashAggregation& other, size_t partition) {
+        for (auto& [key, other_states] : other.partitions_[partition]) {
+            auto it = partitions_[partition].find(key);
+            if (it == partitions_[partition].end()) {
+                partitions_[partition].emplace(key, std::move(other_states));
+                continue;
+            }
+            auto& states = it->second;
+            for (size_t i = 0; i < aggregates_.size(); i++) {
+                if (aggregates_[i].distinct_) {
+                    // DISTINCT 需要按值合并，避免重复计数
+                    for (uint id : other_states[i].seen_) {
+                        if (states[i].seen_.insert(id).second)
+                            Update(partition, aggregates_[i], states[i], id);
+                    }
+                    continue;
+                }
+                states[i].count_ += other_states[i].count_;
+                states[i].numeric_cnt_ += other_states[i].numeric_cnt_;
+                states[i].sum_ += other_states[i].sum_;
+                if (other_states[i].min_ && (!states[i].min_ || Less(partition, other_states[i].min_, states[i].min_)))
+                    states[i].min_ = other_states[i].min_;
+                if (other_states[i].max_ && (!states[i].max_ || Less(partition, states[i].max_, other_states[i].max_)))
+                    states[i].max_ = other_states[i].max_;
+            }
+        }
+        Groups().swap(other.partitions_[partition]);
+    }
+
+    // 按照 variables（投影变量）的顺序输出每一个分组，positions 是分组变量的位置
+    std::vector<std::vector<std::string>> Finish(const std::vector<std::string>& variables,
+                                                 const std::vector<Pos>& positions) {
+        // 没有 GROUP BY 时，即使没有结果也有一个分组
+        if (group_by_.empty() && partitions_[PartitionOf({})].empty())
+            Find(PartitionOf({}), {});
+
+        std::vector<std::pair<bool, size_t>> sources;  // (is aggregate, index)
+        for (const auto& var : variables) {
+            size_t i = 0;
+            while (i < aggregates_.size() && aggregates_[i].alias_ != var)
+                i++;
+            if (i < aggregates_.size()) {
+                sources.emplace_back(true, i);
+            } else {
+                auto it = std::find(group_by_.begin(), group_by_.end(), var);
+                sources.emplace_back(false, it - group_by_.begin());
+            }
+        }
+
+        std::vector<std::vector<std::string>> rows;
+        for (auto& groups : partitions_) {
+            for (auto& [key, states] : groups) {
+                std::vector<std::string> row;
+                for (const auto& [is_aggregate, i] : sources) {
+                    if (is_aggregate)
+                        row.push_back(Value(aggregates_[i], states[i]));
+                    else
+                        row.emplace_back(key[i] ? index_->ID2String(key[i], positions[i], scratch_)
+                                                : std::string_view());
+                }
+                rows.push_back(std::move(row));
+            }
+        }
+        return rows;
+    }
+
+   private:
+    // 使用哈希值的高位选择 partition，低位留给 partition 内部的哈希表
+    size_t PartitionOf(const std::vector<uint>& key) const { return (KeyHash()(key) >> 32) % partitions_.size(); }
+
+    std::vector<State>& Find(size_t partition, const std::vector<uint>& key) {
+        auto& groups = partitions_[partition];
+        auto it = groups.find(key);
+        if (it == groups.end()) {
+            it = groups.emplace(key, std::vector<State>(aggregates_.size())).first;
+            memory_ += sizeof(std::vector<uint>) + key.size() * sizeof(uint) + sizeof(std::vector<State>) +
+                       aggregates_.size() * sizeof(State);
+        }
+        return it->second;
+    }
+
+    // 不同的 partition 可能被不同的线程同时合并，所以解码的缓存也按 partition 划分
+    void Update(size_t partition, const Aggregate& aggregate, State& state, uint id) {
+        state.count_++;
+        switch (aggregate.aggregate_type_) {
+            case Aggregate::Type::Count:
+                break;
+            case Aggregate::Type::Sum:
+            case Aggregate::Type::Avg: {
+                double value;
+                if (Number(partition, id, value)) {
+                    state.sum_ += value;
+                    state.numeric_cnt_++;
+                }
+            } break;
+            case Aggregate::Type::Min:
+                if (!state.min_ || Less(partition, id, state.min_))
+                    state.min_ = id;
+                break;
+            case Aggregate::Type::Max:
+                if (!state.max_ || Less(partition, state.max_, id))
+                    state.max_ = id;
+                break;
+        }
+    }
+
+    bool Number(size_t partition, uint id, double& value) { return values_[partition].Number(id, Pos::kObject, value); }
+
+    bool Less(size_t partition, uint a, uint b) { return values_[partition].Compare(a, b, Pos::kObject) < 0; }
+
+    std::string Value(const Aggregate& aggregate, const State& state) {
+        switch (aggregate.aggregate_type_) {
+            case Aggregate::Type::Count:
+                return FormatNumber(state.count_);
+            case Aggregate::Type::Sum:
+                return state.numeric_cnt_ ? FormatNumber(state.sum_) : "";
+            case Aggregate::Type::Avg:
+                return state.numeric_cnt_ ? FormatNumber(state.sum_ / state.numeric_cnt_) : "";
+            case Aggregate::Type::Min:
+                return std::string(index_->ID2String(state.min_, Pos::kObject, scratch_));
+            case Aggregate::Type::Max:
+                return std::string(index_->ID2String(state.max_, Pos::kObject, scratch_));
+        }
+        return "";
+    }
+
+    static std::string FormatNumber(double value) {
+        std::stringstream ss;
+        if (std::floor(value) == value && std::fabs(value) < 1e15)
+            ss << static_cast<long long>(value);
+        else
+            ss << value;
+        return "\"" + ss.str() + "\"";
+    }
+
+    std::shared_ptr<IndexRetriever> index_;
+    std::vector<std::string> group_by_;
+    std::vector<Aggregate> aggregates_;
+    std::vector<int> group_columns_;
+    std::vector<int> aggregate_columns_;
+    std::vector<Groups> partitions_;
+    size_t memory_ = 0;
+    // 每个 partition 解码过的值
+    std::vector<OrderBy> values_;
+    // 输出时解码压缩字典中的实体
+    std::string scratch_;
+};
+
+#endif  // AGGREGATION_HPP
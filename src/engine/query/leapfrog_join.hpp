@@ -13,12 +13,16 @@
 #include <algorithm>
 #include <vector>
 
+#include "query_guard.hpp"
+
 // uint join_cnt = 0;
 // uint empty_join_cnt = 0;
 // double empty_time = 0;
 
-void LeapfrogJoin(ResultList& pair_begin_end, std::vector<uint>& result_set) {
+// guard 不为空时，每 QueryGuard::kCheckInterval 次迭代检查一次查询是否应该停止，停止时 result_set 只有部分结果
+void LeapfrogJoin(ResultList& pair_begin_end, std::vector<uint>& result_set, QueryGuard* guard = nullptr) {
     uint value;
+    uint ticks = 0;
 
     // Check if any index is empty => Intersection empty
     if (pair_begin_end.HasEmpty())
@@ -33,6 +37,9 @@ void LeapfrogJoin(ResultList& pair_begin_end, std::vector<uint>& result_set) {
     size_t idx = 0;
 
     while (true) {
+        if (guard && ++ticks % QueryGuard::kCheckInterval == 0 && guard->Check())
+            break;
+
         // 当前迭代器的第一个值
         value = pair_begin_end.GetCurrentValOfRange(idx);
 
@@ -66,20 +73,16 @@ void LeapfrogJoin(ResultList& pair_begin_end, std::vector<uint>& result_set) {
     }
 }
 
-std::shared_ptr<std::vector<uint>> LeapfrogJoin(ResultList& indexes) {
+std::shared_ptr<std::vector<uint>> LeapfrogJoin(ResultList& indexes, QueryGuard* guard = nullptr) {
     std::shared_ptr<std::vector<uint>> resultSet = std::make_shared<std::vector<uint>>();
 
     if (indexes.Size() == 1) {
-        std::shared_ptr<std::vector<uint>> result = std::make_shared<std::vector<uint>>();
-        for (uint i = 0; i < indexes.GetRangeByIndex(0)->size(); i++) {
-            result->push_back(indexes.GetRangeByIndex(0)->operator[](i));
-        }
-
-        return result;
+        const auto& range = indexes.GetRangeByIndex(0);
+        return std::make_shared<std::vector<uint>>(range.data(), range.data() + range.size());
     }
 
     // indexes.sizes();
-    LeapfrogJoin(indexes, *resultSet);
+    LeapfrogJoin(indexes, *resultSet, guard);
     // std::cout << "resultSet: " << resultSet->size() << std::endl;
     // sleep(1);
 
@@ -0,0 +1,203 @@
+#ifndef ORDER_BY_HPP
+#define ORDER_BY_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../store/index_retriever.hpp"
+
+// 按照 ORDER BY 的条件比较两个结果（id 组成的元组）
+// 字典的 id 不保持字符串的顺序，所以需要解码后比较，解码结果和解析出的数值会被缓存；
+// id 相同的值一定相等，不需要解码。
+// 维护 top-k 时缓存只保留 heap 中的结果用到的值，结果离开 heap 时删除，缓存的大小不超过 heap
+class OrderBy {
+   public:
+    struct Column {
+        uint index_;  // 在元组中的位置
+        Pos pos_;
+        bool descending_;
+    };
+
+    OrderBy() = default;
+
+    OrderBy(const std::shared_ptr<IndexRetriever>& index, std::vector<Column> columns)
+        : index_(index), columns_(std::move(columns)) {}
+
+    bool empty() const { return columns_.empty(); }
+
+    // a 是否排在 b 之前
+    bool operator()(const std::vector<uint>& a, const std::vector<uint>& b) {
+        for (const auto& column : columns_) {
+            uint a_id = a[column.index_];
+            uint b_id = b[column.index_];
+            if (a_id == b_id)
+                continue;
+            int cmp = Compare(a_id, b_id, column.pos_);
+            if (cmp != 0)
+                return column.descending_ ? cmp > 0 : cmp < 0;
+        }
+        return false;
+    }
+
+    // 在 heap 中保留排在最前面的 k 个结果，heap 的第一个元素是其中排在最后的
+    void PushTopK(std::vector<std::vector<uint>>& heap, const std::vector<uint>& tuple, size_t k) {
+        auto less = [&](const std::vector<uint>& a, const std::vector<uint>& b) { return (*this)(a, b); };
+        if (heap.size() < k) {
+            Pin(tuple);
+            heap.push_back(tuple);
+            std::push_heap(heap.begin(), heap.end(), less);
+        } else if (k != 0 && less(tuple, heap.front())) {
+            Pin(tuple);
+            std::pop_heap(heap.begin(), heap.end(), less);
+            Unpin(heap.back());
+            heap.back() = tuple;
+            std::push_heap(heap.begin(), heap.end(), less);
+        } else {
+            // 没有进入 heap 的结果解码出的值不再需要
+            Unpin(tuple, false);
+        }
+    }
+
+    // 排序并跳过前 offset 个结果
+    void Sort(std::vector<std::vector<uint>>& result, size_t offset, bool is_heap) {
+        auto less = [&](const std::vector<uint>& a, const std::vector<uint>& b) { return (*this)(a, b); };
+        if (is_heap)
+            std::sort_heap(result.begin(), result.end(), less);
+        else
+            std::stable_sort(result.begin(), result.end(), less);
+        result.erase(result.begin(), result.begin() + std::min(offset, result.size()));
+    }
+
+    // 先按类别排序：未绑定（空字符串）在最前，然后是数值字面量（如 "30"、"3.5"^^<...#double>），最后是其他值。
+    // 数值按数值比较，数值相等时再按字符串比较，其他值按字符串比较，这样比较是严格弱序
+    static int CompareTerms(std::string_view a, std::string_view b) {
+        double a_num = 0, b_num = 0;
+        uint a_class = Classify(a, a_num);
+        uint b_class = Classify(b, b_num);
+        return CompareClassified(a_class, a_num, a, b_class, b_num, b);
+    }
+
+    static bool ToNumber(std::string_view term, double& value) {
+        if (term.empty() || term[0] != '"')
+            return false;
+        size_t end = term.find('"', 1);
+        if (end == std::string_view::npos || end == 1)
+            return false;
+        std::string lexical(term.substr(1, end - 1));
+        char* parse_end;
+        value = std::strtod(lexical.c_str(), &parse_end);
+        // NaN 和自身不相等，不能作为数值排序
+        return *parse_end == '\0' && !std::isnan(value);
+    }
+
+    // 比较两个 id 对应的值，a_id 排在前面时返回负数，相等时返回 0
+    int Compare(uint a_id, uint b_id, Pos pos) {
+        if (a_id == b_id)
+            return 0;
+        if (a_id == 0 || b_id == 0)
+            return a_id == 0 ? -1 : 1;  // 未绑定的变量排在最前面
+        const Term& a = Decode(a_id, pos);
+        const Term& b = Decode(b_id, pos);
+        return CompareClassified(a.class_, a.number_, a.text_, b.class_, b.number_, b.text_);
+    }
+
+    // id 对应的值是否是数值字面量，是的时候 value 是它的数值
+    bool Number(uint id, Pos pos, double& value) {
+        const Term& term = Decode(id, pos);
+        value = term.number_;
+        return term.class_ == kNumber;
+    }
+
+    // 缓存的解码结果占用的内存（字节）
+    size_t memory() const { return memory_; }
+
+   private:
+    enum TermClass : uint { kUnbound = 0, kNumber = 1, kOther = 2 };
+
+    struct Term {
+        std::string text_;
+        uint class_;
+        double number_;
+        uint pins_ = 0;  // heap 中使用这个值的结果个数
+    };
+
+    static uint Classify(std::string_view term, double& number) {
+        if (term.empty())
+            return kUnbound;
+        return ToNumber(term, number) ? kNumber : kOther;
+    }
+
+    static int CompareClassified(uint a_class,
+                                 double a_num,
+                                 std::string_view a,
+                                 uint b_class,
+                                 double b_num,
+                                 std::string_view b) {
+        if (a_class != b_class)
+            return a_class < b_class ? -1 : 1;
+        if (a_class == kNumber && a_num != b_num)
+            return a_num < b_num ? -1 : 1;
+        return a.compare(b);
+    }
+
+    // 谓词和实体的 id 是两套编号，缓存的键需要区分
+    static uint64_t Key(uint id, Pos pos) { return (uint64_t(id) << 1) | (pos == kPredicate); }
+
+    static size_t TermBytes(const Term& term) {
+        return sizeof(std::pair<const uint64_t, Term>) + sizeof(void*) +
+               (term.text_.capacity() > sizeof(std::string) ? term.text_.capacity() : 0);
+    }
+
+    Term& Decode(uint id, Pos pos) {
+        auto [it, inserted] = cache_.try_emplace(Key(id, pos));
+        Term& term = it->second;
+        if (inserted) {
+            term.text_ = index_->ID2String(id, pos, scratch_);
+            term.number_ = 0;
+            term.class_ = Classify(term.text_, term.number_);
+            memory_ += TermBytes(term);
+        }
+        return term;
+    }
+
+    // 结果进入 heap，它用到的值在离开 heap 前不会被删除
+    void Pin(const std::vector<uint>& tuple) {
+        for (const auto& column : columns_) {
+            uint id = tuple[column.index_];
+            if (id != 0)
+                Decode(id, column.pos_).pins_++;
+        }
+    }
+
+    // 结果离开 heap（pinned 为 false 时是没有进入 heap），删除不再被 heap 中的结果使用的值
+    void Unpin(const std::vector<uint>& tuple, bool pinned = true) {
+        for (const auto& column : columns_) {
+            uint id = tuple[column.index_];
+            if (id == 0)
+                continue;
+            auto it = cache_.find(Key(id, column.pos_));
+            if (it == cache_.end())
+                continue;
+            if (pinned)
+                it->second.pins_--;
+            if (it->second.pins_ == 0) {
+                memory_ -= TermBytes(it->second);
+                cache_.erase(it);
+            }
+        }
+    }
+
+    std::shared_ptr<IndexRetriever> index_;
+    std::vector<Column> columns_;
+    // 解码过的值，node_hash_map 插入时不会移动已有的元素，比较时可以同时引用两个值
+    phmap::node_hash_map<uint64_t, Term> cache_;
+    size_t memory_ = 0;
+    std::string scratch_;
+};
+
+#endif  // ORDER_BY_HPP
@@ -0,0 +1,127 @@
+#ifndef PLAN_CACHE_HPP
+#define PLAN_CACHE_HPP
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../store/index_retriever.hpp"
+#include "query_plan.hpp"
+
+// 按照查询模板缓存查询计划，容量满时淘汰最久没有使用的计划。
+// 模板是把单变量三元组 (?s p o)、(s p ?o) 中的常量 s、o 替换为占位符后的三元组，
+// 这些常量只决定 prestore_result_，命中时复制缓存的计划并重新查找这些常量（QueryPlan::Rebind），
+// 跳过变量排序和 DFS 路径枚举；谓词和其他位置的常量会影响计划的结构，保留在模板中。
+// 计划中的 Result 指向生成它的索引，每个计划记录自己的索引，只用于同一个索引上的查询
+class PlanCache {
+   public:
+    static constexpr size_t kDefaultCapacity = 1024;
+
+    explicit PlanCache(size_t capacity = kDefaultCapacity) : capacity_(capacity) {}
+
+    std::shared_ptr<QueryPlan> Get(const std::shared_ptr<IndexRetriever>& index,
+                                   const std::vector<std::vector<std::string>>& triple_list,
+                                   size_t limit,
+                                   size_t offset = 0,
+                                   const std::vector<std::pair<std::string, bool>>& order_by = {}) {
+        std::string key = Template(triple_list);
+        std::shared_ptr<const QueryPlan> cached;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = entries_.find(key);
+            if (it != entries_.end() && it->second->index_.lock() == index) {
+                lru_.splice(lru_.begin(), lru_, it->second);
+                cached = it->second->plan_;
+            }
+        }
+        if (cached) {
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            return cached->Rebind(index, triple_list, limit, offset, order_by);
+        }
+
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        // 在锁外生成计划，同一个模板被并发生成时保留先插入的
+        auto plan = std::make_shared<QueryPlan>(index, triple_list, limit, offset, order_by, sampling_budget());
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        if (it != entries_.end() && it->second->index_.lock() != index) {
+            // 其他索引（例如切换前的数据库）上生成的计划
+            lru_.erase(it->second);
+            entries_.erase(it);
+            it = entries_.end();
+        }
+        if (it == entries_.end() && capacity_ > 0) {
+            lru_.push_front({key, index, plan});
+            entries_[key] = lru_.begin();
+            if (lru_.size() > capacity_) {
+                entries_.erase(lru_.back().key_);
+                lru_.pop_back();
+            }
+        }
+        return plan;
+    }
+
+    // 数据库关闭或切换后缓存的计划不会再被使用，清空以释放它们
+    void Clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.clear();
+        lru_.clear();
+    }
+
+    // 之后生成的计划用 microseconds 微秒采样估计基数，已经缓存的计划不受影响
+    void SetSamplingBudget(uint32_t microseconds) { sampling_budget_.store(microseconds, std::memory_order_relaxed); }
+
+    uint32_t sampling_budget() const { return sampling_budget_.load(std::memory_order_relaxed); }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return lru_.size();
+    }
+
+    size_t hits() const { return hits_.load(std::memory_order_relaxed); }
+
+    size_t misses() const { return misses_.load(std::memory_order_relaxed); }
+
+    static std::string Template(const std::vector<std::vector<std::string>>& triple_list) {
+        std::string key;
+        for (const auto& triple : triple_list) {
+            const std::string& s = triple[0];
+            const std::string& p = triple[1];
+            const std::string& o = triple[2];
+            bool univariate = p[0] != '?' && ((s[0] == '?') != (o[0] == '?'));
+            key += univariate && s[0] != '?' ? kSlot : s;
+            key += kTermSeparator;
+            key += p;
+            key += kTermSeparator;
+            key += univariate && o[0] != '?' ? kSlot : o;
+            key += kTripleSeparator;
+        }
+        return key;
+    }
+
+   private:
+    static constexpr const char* kSlot = "$";
+    static constexpr char kTermSeparator = '\x1f';
+    static constexpr char kTripleSeparator = '\x1e';
+
+    struct Entry {
+        std::string key_;
+        // 不延长索引的生命周期，索引关闭后计划不再被使用
+        std::weak_ptr<IndexRetriever> index_;
+        std::shared_ptr<const QueryPlan> plan_;
+    };
+
+    std::mutex mutex_;
+    size_t capacity_;
+    std::list<Entry> lru_;  // 最近使用的在前面
+    hash_map<std::string, std::list<Entry>::iterator> entries_;
+    std::atomic<size_t> hits_{0};
+    std::atomic<size_t> misses_{0};
+    std::atomic<uint32_t> sampling_budget_{0};
+};
+
+#endif  // PLAN_CACHE_HPP
@@ -6,6 +6,7 @@
 #include <cmath>
 #include <condition_variable>
 #include <deque>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <set>
@@ -17,6 +18,8 @@
 #include "../parser/sparql_parser.hpp"
 #include "../store/index_retriever.hpp"
 #include "leapfrog_join.hpp"
+#include "order_by.hpp"
+#include "query_guard.hpp"
 #include "query_plan.hpp"
 
 struct Stat {
@@ -93,9 +96,15 @@ class QueryExecutor {
 
     void Query() {
         _query_begin_time = std::chrono::high_resolution_clock::now();
+        _candidate_bytes.assign(_stat.plan_.size(), 0);
+        _bindings.assign(_stat.plan_.size(), 0);
+        InitOrderBy();
         PreJoin();
 
         for (;;) {
+            if (ShouldStop()) {
+                break;
+            }
             if (_stat.at_end_) {
                 if (_stat.level_ == 0) {
                     break;
@@ -105,20 +114,50 @@ class QueryExecutor {
             } else {
                 // 补完一个查询结果
                 if (_stat.level_ == int(_stat.plan_.size() - 1)) {
-                    _stat.result_.push_back(_stat.current_tuple_);
-                    if (_stat.result_.size() >= _p_query_plan->limit_) {
+                    if (!EmitTuple(_stat)) {
                         break;
                     }
                     Next(_stat);
                 } else {
+                    if (!_adapted && _stat.level_ == 0 && _stat.indices_[0] > kAdaptiveMorsel) {
+                        Adapt(_stat);
+                        continue;
+                    }
                     Down(_stat);
                 }
             }
         }
 
+        if (!_order_by.empty()) {
+            _order_by.Sort(_stat.result_, _p_query_plan->offset_, _p_query_plan->limit_ != UINTMAX_MAX);
+            TrackOrderByMemory();
+        }
+        if (_guard) {
+            _guard->AddMemory(_pending_bytes);
+            _pending_bytes = 0;
+            // 超过内存上限的查询不返回结果
+            if (_guard->MemoryExceeded())
+                std::vector<std::vector<uint>>().swap(_stat.result_);
+        }
+
         _query_end_time = std::chrono::high_resolution_clock::now();
     }
 
+    // 只处理第 0 层候选结果中的第 part 份（共 part_cnt 份），用于多个线程并行执行同一个查询计划
+    void SetPartition(size_t part, size_t part_cnt) {
+        _part = part;
+        _part_cnt = part_cnt;
+    }
+
+    // 查询被 guard 停止（超时或取消）时返回已经得到的结果，
+    // 候选结果、PreJoin 的结果和查询结果占用的内存记录在 guard 中
+    void SetGuard(const std::shared_ptr<QueryGuard>& guard) { _guard = guard; }
+
+    bool Stopped() const { return _guard && _guard->Stopped(); }
+
+    // 结果不再保存到 query_result 中，而是直接交给 sink 处理
+    void SetTupleSink(std::function<void(const std::vector<uint>&)> sink) { _tuple_sink = std::move(sink); }
+
     inline double Duration() {
         return static_cast<std::chrono::duration<double, std::milli>>(_query_end_time - _query_begin_time)
             .count();
@@ -127,6 +166,319 @@ class QueryExecutor {
     [[nodiscard]] std::vector<std::vector<uint>>& query_result() { return _stat.result_; }
 
    private:
+    // 第 0 层处理完这么多个实体后比较观察到的和估计的中间结果大小
+    static constexpr uint kAdaptiveMorsel = 64;
+    // 某一层观察到的绑定个数与估计相差超过这个倍数时重新选择变量的顺序
+    static constexpr double kReplanFactor = 8;
+
+    void InitOrderBy() {
+        std::vector<OrderBy::Column> columns;
+        for (const auto& [variable, descending] : _p_query_plan->order_by_) {
+            const auto& metadata = _p_query_plan->variable_metadata();
+            auto it = metadata.find(variable);
+            if (it != metadata.end())
+                columns.push_back({it->second.first, it->second.second, descending});
+        }
+        _order_by = OrderBy(_p_index, std::move(columns));
+    }
+
+    // 记录一个完整的结果，返回 false 表示已经得到足够的结果
+    bool EmitTuple(Stat& stat) {
+        size_t limit = _p_query_plan->limit_;
+        size_t offset = _p_query_plan->offset_;
+
+        const std::vector<uint>& tuple = OutputTuple(stat);
+        if (_tuple_sink) {
+            _tuple_sink(tuple);
+            return true;
+        }
+
+        if (!_order_by.empty()) {
+            // 有 LIMIT 时只保留排在最前面的 offset + limit 个结果
+            if (limit == UINTMAX_MAX) {
+                stat.result_.push_back(tuple);
+                TrackMemory(TupleBytes(tuple));
+            } else if (stat.result_.size() < offset + limit) {
+                _order_by.PushTopK(stat.result_, tuple, offset + limit);
+                TrackMemory(TupleBytes(tuple));
+            } else {
+                _order_by.PushTopK(stat.result_, tuple, offset + limit);
+            }
+            TrackOrderByMemory();
+            return true;
+        }
+
+        // 没有 ORDER BY 时 OFFSET 的结果直接跳过，不需要保存
+        if (_skipped < offset) {
+            _skipped++;
+            return true;
+        }
+        stat.result_.push_back(tuple);
+        TrackMemory(TupleBytes(tuple));
+        return stat.result_.size() < limit;
+    }
+
+    // 重新排序后的计划中变量所在的层与结果的列不同，按照原来计划的层的顺序输出
+    const std::vector<uint>& OutputTuple(const Stat& stat) {
+        if (_output_levels.empty())
+            return stat.current_tuple_;
+        _output_tuple.resize(stat.current_tuple_.size());
+        for (size_t level = 0; level < stat.current_tuple_.size(); level++) {
+            _output_tuple[_output_levels[level]] = stat.current_tuple_[level];
+        }
+        return _output_tuple;
+    }
+
+    // 第 0 层的前 kAdaptiveMorsel 个实体处理完后调用，此时更高的层都是空的。
+    // 悬空的绑定（在下一层没有任何候选实体）比结果还多时，对剩下的实体做半连接约简（见 Reduce）。
+    // 否则某一层观察到的平均绑定个数与计划的估计相差超过 kReplanFactor 倍时，第 0 层的变量保持不变，
+    // 用观察到的大小重新选择其余变量的顺序，剩下的第 0 层实体（包括当前实体）按照新的计划执行。
+    // 每次执行只检查一次，避免在两个计划之间来回切换
+    void Adapt(Stat& stat) {
+        _adapted = true;
+        // 当前实体已经绑定，但更高的层还没有处理
+        size_t processed = stat.indices_[0] - 1;
+        size_t remaining = stat.candidate_result_[0]->size() - processed;
+        if (remaining < kAdaptiveMorsel)
+            return;
+
+        size_t n = stat.plan_.size();
+        if (_dead_ends >= kAdaptiveMorsel && _dead_ends > _bindings[n - 1] && Reduce(stat, processed))
+            return;
+
+        const auto& estimated = _p_query_plan->estimated_bindings();
+        size_t first_bindings = _bindings[0] - 1;
+        if (n < 3 || estimated.size() != n || first_bindings == 0)
+            return;
+
+        std::vector<double> bindings(n);
+        bool diverged = false;
+        for (size_t level = 0; level < n; level++) {
+            size_t actual = level == 0 ? first_bindings : _bindings[level];
+            bindings[level] = 1.0 * actual / processed;
+            // 按绑定个数加一比较，避免估计或观察为 0 时的误判
+            double expected = estimated[level] * first_bindings;
+            double ratio = (actual + 1) / (expected + 1);
+            if (ratio > kReplanFactor || ratio < 1 / kReplanFactor)
+                diverged = true;
+        }
+        if (!diverged)
+            return;
+
+        std::shared_ptr<QueryPlan> plan = _p_query_plan->Replan(_p_index, bindings, remaining);
+        if (!plan)
+            return;
+
+        const auto& metadata = _p_query_plan->variable_metadata();
+        for (const auto& variable : plan->variables()) {
+            _output_levels.push_back(metadata.at(variable).first);
+        }
+        auto candidates =
+            std::make_shared<std::vector<uint>>(stat.candidate_result_[0]->begin() + processed,
+                                                stat.candidate_result_[0]->end());
+
+        stat.plan_ = plan->query_plan();
+        stat.at_end_ = false;
+        stat.level_ = -1;
+        stat.indices_.assign(n, 0);
+        for (size_t level = 1; level < n; level++) {
+            stat.candidate_result_[level] = std::make_shared<std::vector<uint>>();
+            TrackMemory(-_candidate_bytes[level]);
+            _candidate_bytes[level] = 0;
+        }
+        // 第 0 层只保留还没有处理的实体
+        TrackMemory(int64_t(candidates->size() * sizeof(uint)) - _candidate_bytes[0]);
+        _candidate_bytes[0] = candidates->size() * sizeof(uint);
+        stat.candidate_result_[0] = candidates;
+        _p_query_plan = plan;
+        _prestore_result = plan->prestore_result_;
+        PreJoin();
+    }
+
+    // 无环查询的 Yannakakis 半连接约简：先沿连接树自底向上，父节点只保留在子节点的候选集合中有相邻实体的实体，
+    // 再自顶向下，子节点只保留在父节点的候选集合中有相邻实体的实体。第 0 层的初始候选集合是还没有处理的实体，
+    // 其他变量是它的单变量三元组结果的交集，没有单变量三元组时不限制（nullptr），由半连接从相邻变量的候选集合展开，
+    // 避免物化很大的 S/O 集合。约简后第 0 层从头枚举剩下的实体，其他连通分量的根的集合代替 _prestore_result，
+    // 非根变量的候选结果在 EnumerateItems 中按照约简后的集合过滤，每个候选实体都能扩展到下一层，不会因为悬空的实体回溯。
+    // 约简需要检查每个变量的所有候选实体，选择性好的查询直接枚举更快，所以只在第一批实体出现大量悬空绑定时才约简。
+    // 查询有环、有 LIMIT 没有 ORDER BY（枚举会提前结束）或者被停止时返回 false
+    bool Reduce(Stat& stat, size_t processed) {
+        const auto& semi_joins = _p_query_plan->semi_joins();
+        if (semi_joins.empty())
+            return false;
+        if (_p_query_plan->limit_ != UINTMAX_MAX && _p_query_plan->order_by_.empty())
+            return false;
+        for (const auto& semi_join : semi_joins) {
+            if (semi_join.pid_ == 0 || semi_join.pid_ > _p_index->predicate_cnt())
+                return false;
+        }
+
+        size_t n = stat.plan_.size();
+        std::vector<std::shared_ptr<std::vector<uint>>> candidates(n);
+        candidates[0] = std::make_shared<std::vector<uint>>(stat.candidate_result_[0]->begin() + processed,
+                                                            stat.candidate_result_[0]->end());
+        for (size_t level = 1; level < n; level++) {
+            if (_prestore_result[level].empty())
+                continue;
+            ResultList result_list;
+            if (!result_list.AddVectors(_prestore_result[level]))
+                return false;
+            candidates[level] = LeapfrogJoin(result_list, _guard.get());
+        }
+
+        // 自底向上
+        for (auto it = semi_joins.rbegin(); it != semi_joins.rend(); ++it) {
+            if (!SemiJoin(candidates[it->parent_], it->parent_pos_, it->pid_, candidates[it->child_]))
+                return false;
+        }
+        // 自顶向下
+        for (const auto& semi_join : semi_joins) {
+            Pos child_pos = semi_join.parent_pos_ == Pos::kSubject ? Pos::kObject : Pos::kSubject;
+            if (!SemiJoin(candidates[semi_join.child_], child_pos, semi_join.pid_, candidates[semi_join.parent_]))
+                return false;
+        }
+
+        // 其他变量的候选结果来自父节点的相邻实体，与很大的约简集合求交集需要遍历整个集合，改为逐个二分查找
+        std::vector<bool> is_child(n, false);
+        for (const auto& semi_join : semi_joins) {
+            is_child[semi_join.child_] = true;
+        }
+        _reduced.assign(n, nullptr);
+        for (size_t level = 1; level < n; level++) {
+            if (!candidates[level])
+                continue;
+            TrackMemory(candidates[level]->size() * sizeof(uint));
+            if (is_child[level]) {
+                _reduced[level] = candidates[level];
+                continue;
+            }
+            _reduced_roots.push_back(candidates[level]);
+            _prestore_result[level] = {Result(candidates[level]->data(), candidates[level]->size())};
+        }
+
+        TrackMemory(int64_t(candidates[0]->size() * sizeof(uint)) - _candidate_bytes[0]);
+        _candidate_bytes[0] = candidates[0]->size() * sizeof(uint);
+        stat.candidate_result_[0] = candidates[0];
+        stat.indices_[0] = 0;
+        // 剩下的实体都被约简掉时直接结束，不能让 Down 重新生成第 0 层
+        stat.level_ = candidates[0]->empty() ? 0 : -1;
+        stat.at_end_ = candidates[0]->empty();
+        return true;
+    }
+
+    // 只保留 entities 中通过谓词 pid 在 others 中有相邻实体的实体，pos 是 entities 在三元组中的位置，
+    // nullptr 表示不限制。entities 较小时逐个查找它的相邻实体，否则展开 others 的相邻实体再求交集。
+    // 查询被停止时返回 false
+    bool SemiJoin(std::shared_ptr<std::vector<uint>>& entities,
+                  Pos pos,
+                  uint pid,
+                  const std::shared_ptr<std::vector<uint>>& others) {
+        bool subject = pos == Pos::kSubject;
+        if (!others) {
+            // 另一端不限制时，只要求实体在谓词的 S/O 集合中
+            Result set = subject ? _p_index->GetSSet(pid) : _p_index->GetOSet(pid);
+            if (!entities)
+                entities = std::make_shared<std::vector<uint>>(set.data(), set.data() + set.size());
+            else
+                Filter(*entities, set.data(), set.size());
+            return true;
+        }
+
+        if (entities && entities->size() <= others->size()) {
+            size_t kept = 0;
+            for (uint entity : *entities) {
+                if (ShouldStop())
+                    return false;
+                Result neighbors = subject ? _p_index->GetByPS(pid, entity) : _p_index->GetByPO(pid, entity);
+                if (Intersects(neighbors.data(), neighbors.size(), *others))
+                    (*entities)[kept++] = entity;
+            }
+            entities->resize(kept);
+            return true;
+        }
+
+        std::vector<uint> expanded;
+        for (uint other : *others) {
+            if (ShouldStop())
+                return false;
+            Result neighbors = subject ? _p_index->GetByPO(pid, other) : _p_index->GetByPS(pid, other);
+            expanded.insert(expanded.end(), neighbors.data(), neighbors.data() + neighbors.size());
+        }
+        std::sort(expanded.begin(), expanded.end());
+        expanded.erase(std::unique(expanded.begin(), expanded.end()), expanded.end());
+        if (!entities)
+            entities = std::make_shared<std::vector<uint>>(std::move(expanded));
+        else
+            Filter(*entities, expanded.data(), expanded.size());
+        return true;
+    }
+
+    // 只保留 entities 中也在 reduced 中的实体，两者都是升序
+    static void Filter(std::vector<uint>& entities, const uint* reduced, size_t size) {
+        size_t kept = 0;
+        const uint* begin = reduced;
+        const uint* end = reduced + size;
+        for (uint entity : entities) {
+            begin = std::lower_bound(begin, end, entity);
+            if (begin == end)
+                break;
+            if (*begin == entity)
+                entities[kept++] = entity;
+        }
+        entities.resize(kept);
+    }
+
+    // 两个升序数组是否有相同的元素，遍历较短的数组，在较长的数组中二分查找
+    static bool Intersects(const uint* values, size_t size, const std::vector<uint>& others) {
+        const uint* begin = others.data();
+        const uint* end = others.data() + others.size();
+        if (size <= others.size()) {
+            for (size_t i = 0; i < size && begin != end; i++) {
+                begin = std::lower_bound(begin, end, values[i]);
+                if (begin != end && *begin == values[i])
+                    return true;
+            }
+            return false;
+        }
+        const uint* values_end = values + size;
+        for (const uint* other = begin; other != end && values != values_end; other++) {
+            values = std::lower_bound(values, values_end, *other);
+            if (values != values_end && *values == *other)
+                return true;
+        }
+        return false;
+    }
+
+    // 内存的变化先在本地累计，减少对共享计数的写入
+    void TrackMemory(int64_t bytes) {
+        if (!_guard)
+            return;
+        _pending_bytes += bytes;
+        if (_pending_bytes >= QueryGuard::kTrackBytes || _pending_bytes <= -QueryGuard::kTrackBytes) {
+            _guard->AddMemory(_pending_bytes);
+            _pending_bytes = 0;
+        }
+    }
+
+    // 排序缓存的解码结果也计入查询的内存
+    void TrackOrderByMemory() {
+        TrackMemory(int64_t(_order_by.memory()) - _order_by_bytes);
+        _order_by_bytes = _order_by.memory();
+    }
+
+    static int64_t TupleBytes(const std::vector<uint>& tuple) {
+        return sizeof(std::vector<uint>) + tuple.size() * sizeof(uint);
+    }
+
+    // 每 kCheckInterval 次调用读取一次时钟，其余时候只检查停止标记
+    bool ShouldStop() {
+        if (!_guard)
+            return false;
+        if (++_ticks % QueryGuard::kCheckInterval == 0)
+            return _guard->Check();
+        return _guard->Stopped();
+    }
+
     bool PreJoin() {
         ResultList result_list;
         std::stringstream key;
@@ -147,13 +499,15 @@ class QueryExecutor {
 
             for (long unsigned int i = 0; i < _stat.plan_[level_].size(); i++) {
                 if (_stat.plan_[level_][i].search_type_ != QueryPlan::Item::TypeT::kNone) {
-                    key << _stat.plan_[level_][i].search_result_->id;
-                    key << "_";
+                    key << PreJoinKey(_stat.plan_[level_][i]);
                     result_list.AddVector(_stat.plan_[level_][i].search_result_);
                 }
             }
-            if (result_list.Size() > 1) {
-                _pre_join_result[key.str()] = LeapfrogJoin(result_list);
+            // 重新排序后再次调用时，已经计算过的交集不需要重新计算
+            if (result_list.Size() > 1 && !_pre_join_result.count(key.str())) {
+                auto& result = _pre_join_result[key.str()];
+                result = LeapfrogJoin(result_list, _guard.get());
+                TrackMemory(result->size() * sizeof(uint));
             }
             result_list.Clear();
             key.str("");
@@ -161,15 +515,28 @@ class QueryExecutor {
         return true;
     }
 
+    // 非 none 类型的 item 的查询结果是谓词的 S/O 集合，由 (search_type_, search_code_) 唯一确定，
+    // 不使用 Result::id，因为共享的集合可能被并发生成的其他查询计划改写
+    static std::string PreJoinKey(const QueryPlan::Item& item) {
+        return std::to_string(item.search_type_) + ":" + std::to_string(item.search_code_) + "_";
+    }
+
     void Down(Stat& stat) {
         ++stat.level_;
         // sleep(2);
 
+        size_t bound = _bindings[stat.level_];
         // 如果当前层没有查询结果，就生成结果
         if (stat.candidate_result_[stat.level_]->empty()) {
             // check whether there are some have the Item::Type_T::None
             EnumerateItems(stat);
+            if (stat.level_ == 0 && _part_cnt > 1) {
+                Partition(stat);
+            }
+            _candidate_bytes[stat.level_] = stat.candidate_result_[stat.level_]->size() * sizeof(uint);
+            TrackMemory(_candidate_bytes[stat.level_]);
             if (stat.at_end_) {
+                _dead_ends++;
                 return;
             }
         }
@@ -179,16 +546,31 @@ class QueryExecutor {
 
         bool success = UpdateCurrentTuple(stat);
         // 不成功则继续
-        while (!success && !stat.at_end_) {
+        while (!success && !stat.at_end_ && !ShouldStop()) {
             success = UpdateCurrentTuple(stat);
         }
+        // 上一层的绑定在这一层没有任何实体
+        if (stat.at_end_ && _bindings[stat.level_] == bound)
+            _dead_ends++;
         // sleep(2);
     }
 
+    void Partition(Stat& stat) {
+        auto& candidates = stat.candidate_result_[0];
+        size_t size = candidates->size();
+        size_t begin = size * _part / _part_cnt;
+        size_t end = size * (_part + 1) / _part_cnt;
+        candidates = std::make_shared<std::vector<uint>>(candidates->begin() + begin, candidates->begin() + end);
+        if (candidates->empty())
+            stat.at_end_ = true;
+    }
+
     void Up(Stat& stat) {
         // 清除较高 level_ 的查询结果
         stat.candidate_result_[stat.level_]->clear();
         stat.indices_[stat.level_] = 0;
+        TrackMemory(-_candidate_bytes[stat.level_]);
+        _candidate_bytes[stat.level_] = 0;
 
         --stat.level_;
     }
@@ -197,7 +579,7 @@ class QueryExecutor {
         // 当前 level_ 的下一个 candidate_result_
         stat.at_end_ = false;
         bool success = UpdateCurrentTuple(stat);
-        while (!success && !stat.at_end_) {
+        while (!success && !stat.at_end_ && !ShouldStop()) {
             success = UpdateCurrentTuple(stat);
         }
     }
@@ -235,8 +617,7 @@ class QueryExecutor {
                 std::stringstream key_stream;
                 for (const auto& idx : item_other_type_indices_) {
                     if (_pre_join_result.size() != 0) {
-                        key_stream << stat.plan_[stat.level_][idx].search_result_->id;
-                        key_stream << "_";
+                        key_stream << PreJoinKey(stat.plan_[stat.level_][idx]);
                     }
                 }
                 std::string key = key_stream.str();
@@ -258,21 +639,24 @@ class QueryExecutor {
                     result_list.AddVector(stat.plan_[stat.level_][idx].search_result_);
                 }
             }
-            stat.candidate_result_[stat.level_] = LeapfrogJoin(result_list);
+            stat.candidate_result_[stat.level_] = LeapfrogJoin(result_list, _guard.get());
         }
         if (join_case == 1) {
             // for (const auto& idx : item_other_type_indices_) {
             //     result_list.AddVector(stat.plan_[stat.level_][idx].search_result_);
             // }
             // stat.candidate_result_[stat.level_] = LeapfrogJoin(result_list);
-            std::shared_ptr<Result> range = result_list.GetRangeByIndex(0);
-            stat.candidate_result_[stat.level_] = std::make_shared<std::vector<uint>>();
-            for (uint i = 0; i < range->size(); i++) {
-                stat.candidate_result_[stat.level_]->push_back(range->operator[](i));
-            }
+            const Result& range = result_list.GetRangeByIndex(0);
+            stat.candidate_result_[stat.level_] =
+                std::make_shared<std::vector<uint>>(range.data(), range.data() + range.size());
         }
         if (join_case > 1) {
-            stat.candidate_result_[stat.level_] = LeapfrogJoin(result_list);
+            stat.candidate_result_[stat.level_] = LeapfrogJoin(result_list, _guard.get());
+        }
+
+        if (!_reduced.empty() && _reduced[stat.level_]) {
+            const auto& reduced = *_reduced[stat.level_];
+            Filter(*stat.candidate_result_[stat.level_], reduced.data(), reduced.size());
         }
 
         // 变量的交集为空
@@ -295,6 +679,7 @@ class QueryExecutor {
             // if also have the other type item(s), search predicate path for these item(s)
             if (!have_other_type) {
                 stat.current_tuple_[stat.level_] = entity;
+                _bindings[stat.level_]++;
                 ++idx;
                 stat.indices_[stat.level_] = idx;
                 return true;
@@ -304,6 +689,7 @@ class QueryExecutor {
             // 只更新 candidate_result_ 里的符合查询条件的 none 类型
             if (search_predicate_path(stat, entity)) {
                 stat.current_tuple_[stat.level_] = entity;
+                _bindings[stat.level_]++;
                 ++idx;
                 stat.indices_[stat.level_] = idx;
                 return true;
@@ -324,38 +710,17 @@ class QueryExecutor {
         bool match = true;
         // 遍历一个变量（level_）的在所有三元组中的查询结果
         for (auto& item : stat.plan_[stat.level_]) {
-            if (item.search_type_ == QueryPlan::Item::TypeT::kPS) {
-                size_t other = item.candidate_result_idx_;
-
-                // 遍历当前三元组none所在的level_
-                for (auto& other_item : stat.plan_[other]) {
-                    if (other_item.search_code_ != item.search_code_) {
-                        // 确保谓词相同，在一个三元组中
-                        continue;
-                    }
-
-                    other_item.search_result_ = _p_index->GetByPO(item.search_code_, entity);
-                    if (other_item.search_result_->size() == 0) {
-                        match = false;
-                    }
-
-                    break;
-                }
-            } else if (item.search_type_ == QueryPlan::Item::TypeT::kPO) {
-                size_t other = item.candidate_result_idx_;
-
-                for (auto& other_item : stat.plan_[other]) {
-                    if (other_item.search_code_ != item.search_code_) {
-                        continue;
-                    }
-
-                    other_item.search_result_ = _p_index->GetByPS(item.search_code_, entity);
-                    if (other_item.search_result_->size() == 0) {
-                        match = false;
-                    }
+            if (item.search_type_ == QueryPlan::Item::TypeT::kNone)
+                continue;
 
-                    break;
-                }
+            // 填补这个三元组在另一个变量所在层的 none 类型 item
+            auto& other_item = stat.plan_[item.candidate_result_idx_][item.candidate_item_idx_];
+            if (item.search_type_ == QueryPlan::Item::TypeT::kPS)
+                other_item.search_result_ = _p_index->GetByPO(item.search_code_, entity);
+            else
+                other_item.search_result_ = _p_index->GetByPS(item.search_code_, entity);
+            if (other_item.search_result_.size() == 0) {
+                match = false;
             }
         }
         return match;
@@ -366,12 +731,38 @@ class QueryExecutor {
     OutputStat _output_stat;
     std::shared_ptr<IndexRetriever> _p_index;
     std::shared_ptr<QueryPlan> _p_query_plan;
-    std::vector<std::vector<std::shared_ptr<Result>>> _prestore_result;
+    std::vector<std::vector<Result>> _prestore_result;
     std::shared_ptr<std::vector<std::string>> _p_project_variables;
 
     std::chrono::system_clock::time_point _query_begin_time, _query_end_time;
 
     hash_map<std::string, std::shared_ptr<std::vector<uint>>> _pre_join_result;
+
+    OrderBy _order_by;
+    int64_t _order_by_bytes = 0;
+    size_t _skipped = 0;
+
+    size_t _part = 0;
+    size_t _part_cnt = 1;
+    std::function<void(const std::vector<uint>&)> _tuple_sink;
+
+    std::shared_ptr<QueryGuard> _guard;
+    uint _ticks = 0;
+    int64_t _pending_bytes = 0;
+    std::vector<int64_t> _candidate_bytes;
+
+    // 每一层成功绑定的实体个数
+    std::vector<size_t> _bindings;
+    // 悬空的绑定个数：下一层没有任何实体可以绑定
+    size_t _dead_ends = 0;
+    bool _adapted = false;
+    // 半连接约简后连接树中非根变量的候选集合，见 Reduce
+    std::vector<std::shared_ptr<std::vector<uint>>> _reduced;
+    // 约简后代替 _prestore_result 的集合，_prestore_result 中的 Result 指向它们
+    std::vector<std::shared_ptr<std::vector<uint>>> _reduced_roots;
+    // 重新排序后，新计划的第 i 层是结果的第 _output_levels[i] 列
+    std::vector<uint> _output_levels;
+    std::vector<uint> _output_tuple;
 };
 
 #endif  // QUERY_EXECUTOR_HPP
@@ -0,0 +1,105 @@
+#ifndef QUERY_GUARD_HPP
+#define QUERY_GUARD_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+// 查询的截止时间、取消标记和内存统计，一个查询的所有执行线程共享同一个 QueryGuard。
+// 执行器每迭代 kCheckInterval 次才读取一次时钟，其余时候只读取停止标记。
+// 查询可以通过外部的取消标记（QueryOptions::cancel）或者检查函数（例如 HTTP 客户端是否已经断开）取消，
+// 检查函数的代价较高，最多每 kCancelPollMs 毫秒调用一次。
+// 超时或取消的查询返回已经得到的结果（部分结果），超过内存上限的查询不返回结果
+class QueryGuard {
+   public:
+    static constexpr uint kCheckInterval = 1024;
+    // 执行器在本地累计内存的变化，超过 kTrackBytes 后才更新共享的计数
+    static constexpr int64_t kTrackBytes = 64 << 10;
+    static constexpr uint kCancelPollMs = 10;
+
+    // timeout_ms 为 0 表示没有时间限制，memory_limit（字节）为 0 表示没有内存限制
+    explicit QueryGuard(uint timeout_ms = 0, size_t memory_limit = 0)
+        : has_deadline_(timeout_ms != 0),
+          deadline_(std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms)),
+          memory_limit_(memory_limit) {}
+
+    // 以下两个函数在查询开始执行之前调用
+    void SetCancelFlag(std::shared_ptr<std::atomic<bool>> flag) { cancel_flag_ = std::move(flag); }
+
+    // check 可能被多个执行线程调用，但不会同时调用
+    void SetCancelCheck(std::function<bool()> check) { cancel_check_ = std::move(check); }
+
+    void Cancel() {
+        cancelled_.store(true, std::memory_order_relaxed);
+        stopped_.store(true, std::memory_order_relaxed);
+    }
+
+    // 检查是否超时或者被取消，返回查询是否应该停止
+    bool Check() {
+        if (Stopped())
+            return true;
+        if (cancel_flag_ && cancel_flag_->load(std::memory_order_relaxed))
+            Cancel();
+        if (!has_deadline_ && !cancel_check_)
+            return Stopped();
+
+        auto now = std::chrono::steady_clock::now();
+        if (has_deadline_ && now >= deadline_) {
+            timed_out_.store(true, std::memory_order_relaxed);
+            stopped_.store(true, std::memory_order_relaxed);
+        }
+        if (cancel_check_ && ClaimPoll(now) && cancel_check_())
+            Cancel();
+        return Stopped();
+    }
+
+    // 记录查询占用的内存的变化（字节），超过上限时停止查询
+    void AddMemory(int64_t bytes) {
+        int64_t memory = memory_.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        int64_t peak = peak_memory_.load(std::memory_order_relaxed);
+        while (memory > peak && !peak_memory_.compare_exchange_weak(peak, memory, std::memory_order_relaxed)) {
+        }
+        if (memory_limit_ && memory > int64_t(memory_limit_)) {
+            memory_exceeded_.store(true, std::memory_order_relaxed);
+            stopped_.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    bool Stopped() const { return stopped_.load(std::memory_order_relaxed); }
+
+    bool TimedOut() const { return timed_out_.load(std::memory_order_relaxed); }
+
+    bool Cancelled() const { return cancelled_.load(std::memory_order_relaxed); }
+
+    bool MemoryExceeded() const { return memory_exceeded_.load(std::memory_order_relaxed); }
+
+    size_t PeakMemory() const { return peak_memory_.load(std::memory_order_relaxed); }
+
+    size_t memory_limit() const { return memory_limit_; }
+
+   private:
+    // 距离上次调用检查函数超过 kCancelPollMs 毫秒时，只让一个线程调用
+    bool ClaimPoll(std::chrono::steady_clock::time_point now) {
+        int64_t ticks = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
+        int64_t next = next_poll_.load(std::memory_order_relaxed);
+        return ticks >= next &&
+               next_poll_.compare_exchange_strong(next, ticks + kCancelPollMs, std::memory_order_relaxed);
+    }
+
+    bool has_deadline_;
+    std::chrono::steady_clock::time_point deadline_;
+    size_t memory_limit_;
+    std::atomic<bool> stopped_{false};
+    std::atomic<bool> timed_out_{false};
+    std::atomic<bool> cancelled_{false};
+    std::shared_ptr<std::atomic<bool>> cancel_flag_;
+    std::function<bool()> cancel_check_;
+    std::atomic<int64_t> next_poll_{0};
+    std::atomic<bool> memory_exceeded_{false};
+    std::atomic<int64_t> memory_{0};
+    std::atomic<int64_t> peak_memory_{0};
+};
+
+#endif  // QUERY_GUARD_HPP
@@ -2,9 +2,14 @@
 #define QUERY_PLAN_HPP
 
 #include <parallel_hashmap/phmap.h>
+#include <algorithm>
+#include <chrono>
 #include <climits>
+#include <functional>
+#include <memory>
 #include <numeric>  // 包含 accumulate 函数
 #include <string>
+#include <tuple>
 #include <vector>
 
 #include "../store/index_retriever.hpp"
@@ -26,8 +31,11 @@ class QueryPlan {
         uint search_code_;             // search this code from corresponding index according to
                                        // `curr_search_type_`
         size_t candidate_result_idx_;  // the next value location index
+        // 非 none 类型的 item 对应的 none 类型 item 在 candidate_result_idx_ 层中的位置，
+        // 同一层可能有多个谓词相同的 none 类型 item，不能按照谓词查找
+        size_t candidate_item_idx_ = 0;
         // 一对迭代器，第一个是起始位置，第二个是结束位置
-        std::shared_ptr<Result> search_result_;
+        Result search_result_;
 
         Item() = default;
 
@@ -35,6 +43,7 @@ class QueryPlan {
             : search_type_(other.search_type_),
               search_code_(other.search_code_),
               candidate_result_idx_(other.candidate_result_idx_),
+              candidate_item_idx_(other.candidate_item_idx_),
               search_result_(other.search_result_) {}
 
         Item& operator=(const Item& other) {
@@ -42,6 +51,7 @@ class QueryPlan {
                 search_type_ = other.search_type_;
                 search_code_ = other.search_code_;
                 candidate_result_idx_ = other.candidate_result_idx_;
+                candidate_item_idx_ = other.candidate_item_idx_;
                 search_result_ = other.search_result_;
             }
             return *this;
@@ -50,8 +60,11 @@ class QueryPlan {
 
     QueryPlan(const std::shared_ptr<IndexRetriever>& index,
               const std::vector<std::vector<std::string>>& triple_list,
-              size_t limit_)
-        : limit_(limit_) {
+              size_t limit_,
+              size_t offset_ = 0,
+              std::vector<std::pair<std::string, bool>> order_by_ = {},
+              uint32_t sampling_budget = 0)
+        : limit_(limit_), offset_(offset_), order_by_(std::move(order_by_)), sampling_budget_(sampling_budget) {
         Generate(index, triple_list);
     }
 
@@ -109,11 +122,270 @@ class QueryPlan {
         return allPaths;
     }
 
+    // 连接树上的一条边：parent_ 层的变量通过谓词 pid_ 连接 child_ 层的变量，parent_pos_ 是父节点在三元组中的位置
+    struct SemiJoin {
+        size_t parent_;
+        size_t child_;
+        uint pid_;
+        Pos parent_pos_;
+    };
+
+    // 执行时观察到的中间结果大小，见 Replan
+    struct Feedback {
+        std::vector<std::string> order_;
+        std::vector<double> bindings_;
+        double first_size_;
+    };
+
+    // 按照谓词的统计信息选择变量的顺序，使每一层中间结果的估计大小之和最小。
+    // 变量集合 X 的中间结果大小估计为 X 中每个变量候选集合大小的乘积，再乘以两端都在 X 中的三元组的选择率
+    // （假设谓词均匀地连接主语和宾语，三元组之间相互独立）。这个估计与变量的顺序无关，
+    // 变量不超过 kMaxDPVariables 个时对变量子集动态规划求最优顺序，否则每次贪心地加入使中间结果最小的变量。
+    // 主语相同的星形用特征集合修正候选集合和选择率。有变量谓词时返回空，由 Generate 按照查询图的形状排序。
+    // feedback 不为空时第一个变量固定为 feedback 中的第一个变量，已经执行过的前缀使用观察到的中间结果大小
+    std::vector<std::string> CostBasedOrder(const std::shared_ptr<IndexRetriever>& index,
+                                            const std::vector<std::vector<std::string>>& triple_list,
+                                            const Feedback* feedback = nullptr) {
+        if (!index->has_statistics())
+            return {};
+
+        std::vector<std::string> variables;
+        hash_map<std::string, uint> variable_ids;
+        // 变量的候选集合大小
+        std::vector<double> domain;
+        // 变量 -> (另一端的变量, 选择率)
+        std::vector<std::vector<std::pair<uint, double>>> edges;
+        // 变量作为主语的星形中的谓词
+        std::vector<std::vector<uint>> star_predicates;
+        // 双变量三元组
+        std::vector<Join> joins;
+        // 变量 -> 变量所在的三元组，采样时用来判断一个实体是否满足变量的所有三元组
+        std::vector<std::vector<Constraint>> constraints;
+        auto variable_id = [&](const std::string& variable) {
+            auto it = variable_ids.find(variable);
+            if (it != variable_ids.end())
+                return it->second;
+            variable_ids[variable] = variables.size();
+            variables.push_back(variable);
+            domain.push_back(index->entity_cnt());
+            edges.emplace_back();
+            star_predicates.emplace_back();
+            constraints.emplace_back();
+            return uint(variables.size() - 1);
+        };
+        // 谓词不存在时结果为空，所有候选集合的大小按 0 估计
+        static const PredicateStatistics empty;
+
+        for (const auto& triple : triple_list) {
+            const std::string& s = triple[0];
+            const std::string& p = triple[1];
+            const std::string& o = triple[2];
+            if (p[0] == '?')
+                return {};
+
+            uint pid = index->String2ID(p, Pos::kPredicate);
+            const PredicateStatistics* stats = index->GetPredicateStatistics(pid);
+            if (stats == nullptr)
+                stats = &empty;
+
+            if (s[0] == '?' && o[0] == '?') {
+                uint sid = variable_id(s);
+                uint oid = variable_id(o);
+                domain[sid] = std::min<double>(domain[sid], stats->distinct_subjects_);
+                domain[oid] = std::min<double>(domain[oid], stats->distinct_objects_);
+                edges[sid].emplace_back(oid, stats->Selectivity());
+                constraints[sid].push_back({Pos::kSubject, pid, 0});
+                constraints[oid].push_back({Pos::kObject, pid, 0});
+                if (sid != oid) {
+                    edges[oid].emplace_back(sid, stats->Selectivity());
+                    star_predicates[sid].push_back(pid);
+                    joins.push_back({sid, oid, pid, edges[sid].size() - 1, edges[oid].size() - 1});
+                }
+            } else if (s[0] == '?') {
+                uint constant = index->String2ID(o, Pos::kObject);
+                uint sid = variable_id(s);
+                domain[sid] = std::min<double>(domain[sid], index->GetByPOSize(pid, constant));
+                star_predicates[sid].push_back(pid);
+                constraints[sid].push_back({Pos::kSubject, pid, constant});
+            } else if (o[0] == '?') {
+                uint constant = index->String2ID(s, Pos::kSubject);
+                uint oid = variable_id(o);
+                domain[oid] = std::min<double>(domain[oid], index->GetByPSSize(pid, constant));
+                constraints[oid].push_back({Pos::kObject, pid, constant});
+            }
+        }
+
+        size_t n = variables.size();
+        if (n == 0)
+            return {};
+
+        // 主语变量有两个以上不同谓词的星形，谓词之间往往相关（例如有 name 的主语通常也有 type），
+        // 用特征集合估计主语个数，以及这些主语上每个谓词的平均宾语个数，代替按照独立假设的估计
+        const CharacteristicSets& characteristic_sets = index->characteristic_sets();
+        std::vector<std::vector<double>> star_fanouts(n);
+        for (uint v = 0; v < n && !characteristic_sets.empty(); v++) {
+            auto& predicates = star_predicates[v];
+            std::sort(predicates.begin(), predicates.end());
+            predicates.erase(std::unique(predicates.begin(), predicates.end()), predicates.end());
+            if (predicates.size() < 2 || predicates.front() == 0)
+                continue;
+            double subjects = characteristic_sets.EstimateStar(predicates, star_fanouts[v]);
+            domain[v] = std::min(domain[v], subjects);
+        }
+        for (const auto& join : joins) {
+            if (star_fanouts[join.sid_].empty())
+                continue;
+            auto& predicates = star_predicates[join.sid_];
+            double fanout = star_fanouts[join.sid_][std::lower_bound(predicates.begin(), predicates.end(), join.pid_) -
+                                                    predicates.begin()];
+            // 宾语变量的候选集合是谓词的宾语集合时，两个变量连接的大小为 主语个数 * 平均宾语个数
+            uint objects = index->GetPredicateStatistics(join.pid_)->distinct_objects_;
+            double selectivity = objects ? fanout / objects : 0;
+            edges[join.sid_][join.s_edge_].second = selectivity;
+            edges[join.oid_][join.o_edge_].second = selectivity;
+        }
+
+        if (sampling_budget_ > 0 && n > 1)
+            Sample(index, constraints, joins, domain, edges);
+
+        // 前缀中的变量 -> 观察到的中间结果大小
+        uint pinned = n;
+        std::vector<std::pair<std::vector<uint>, double>> observed;
+        if (feedback != nullptr) {
+            pinned = variable_ids.at(feedback->order_[0]);
+            domain[pinned] = feedback->first_size_;
+            std::vector<uint> prefix;
+            for (size_t i = 0; i < feedback->bindings_.size() && i < feedback->order_.size(); i++) {
+                prefix.push_back(variable_ids.at(feedback->order_[i]));
+                observed.emplace_back(prefix, feedback->first_size_ * feedback->bindings_[i]);
+            }
+        }
+
+        // 在 added(u) 为真的变量之后加入变量 v，中间结果的大小变为原来的多少倍
+        auto growth = [&](const auto& added, uint v) {
+            double factor = domain[v];
+            for (const auto& [other, selectivity] : edges[v]) {
+                if (other == v || added(other))
+                    factor *= selectivity;
+            }
+            return factor;
+        };
+
+        std::vector<uint> order;
+        // 每个前缀的中间结果大小
+        std::vector<double> prefix_cards;
+        if (n <= kMaxDPVariables) {
+            uint64_t full = (uint64_t(1) << n) - 1;
+            std::vector<double> card(full + 1, 1);
+            std::vector<double> cost(full + 1, 0);
+            std::vector<uint> last(full + 1, 0);
+            hash_map<uint64_t, double> observed_cards;
+            for (const auto& [prefix, prefix_card] : observed) {
+                uint64_t mask = 0;
+                for (uint v : prefix) {
+                    mask |= uint64_t(1) << v;
+                }
+                observed_cards[mask] = prefix_card;
+            }
+            // 固定了第一个变量时，只有包含它的子集是有效的前缀
+            uint64_t pinned_bit = pinned < n ? uint64_t(1) << pinned : 0;
+            auto valid = [pinned_bit](uint64_t mask) { return mask == 0 || pinned_bit == 0 || (mask & pinned_bit); };
+            for (uint64_t mask = 1; mask <= full; mask++) {
+                uint low = __builtin_ctzll(mask);
+                uint64_t rest = mask & (mask - 1);
+                card[mask] = card[rest] * growth([rest](uint u) { return rest >> u & 1; }, low);
+                auto it = observed_cards.find(mask);
+                if (it != observed_cards.end())
+                    card[mask] = it->second;
+
+                cost[mask] = -1;
+                for (uint v = 0; v < n; v++) {
+                    uint64_t prev = mask ^ (uint64_t(1) << v);
+                    if ((mask >> v & 1) && valid(prev) && cost[prev] >= 0 &&
+                        (cost[mask] < 0 || cost[prev] < cost[mask])) {
+                        cost[mask] = cost[prev];
+                        last[mask] = v;
+                    }
+                }
+                if (cost[mask] >= 0)
+                    cost[mask] += card[mask];
+            }
+            for (uint64_t mask = full; mask; mask ^= uint64_t(1) << last[mask]) {
+                order.push_back(last[mask]);
+            }
+            std::reverse(order.begin(), order.end());
+            uint64_t mask = 0;
+            for (uint v : order) {
+                mask |= uint64_t(1) << v;
+                prefix_cards.push_back(card[mask]);
+            }
+
+            if (debug_)
+                std::cout << "estimated cost: " << cost[full] << std::endl;
+        } else {
+            std::vector<bool> added(n, false);
+            auto is_added = [&added](uint u) { return bool(added[u]); };
+            double card = 1;
+            while (order.size() < n) {
+                uint best = pinned < n && order.empty() ? pinned : n;
+                double best_card = best < n ? card * growth(is_added, best) : 0;
+                for (uint v = 0; v < n && !(pinned < n && order.empty()); v++) {
+                    if (added[v])
+                        continue;
+                    double next_card = card * growth(is_added, v);
+                    if (best == n || next_card < best_card) {
+                        best = v;
+                        best_card = next_card;
+                    }
+                }
+                added[best] = true;
+                card = best_card;
+                order.push_back(best);
+                // 加入的变量恰好是一个执行过的前缀时使用观察到的大小
+                if (order.size() <= observed.size()) {
+                    const auto& prefix = observed[order.size() - 1].first;
+                    if (std::all_of(prefix.begin(), prefix.end(), is_added))
+                        card = observed[order.size() - 1].second;
+                }
+                prefix_cards.push_back(card);
+            }
+        }
+
+        // 执行时与观察到的中间结果比较，见 QueryExecutor::Adapt
+        estimated_bindings_.clear();
+        if (prefix_cards[0] > 0) {
+            for (double prefix_card : prefix_cards) {
+                estimated_bindings_.push_back(prefix_card / prefix_cards[0]);
+            }
+        }
+
+        std::vector<std::string> plan;
+        for (uint v : order) {
+            plan.push_back(variables[v]);
+            if (debug_)
+                std::cout << variables[v] << ": " << domain[v] << std::endl;
+        }
+        return plan;
+    }
+
     void Generate(const std::shared_ptr<IndexRetriever>& index,
                   const std::vector<std::vector<std::string>>& triple_list) {
+        triple_list_ = triple_list;
+        std::vector<std::string> cost_based_plan = CostBasedOrder(index, triple_list);
+        if (!cost_based_plan.empty()) {
+            GenPlanTable(index, triple_list, cost_based_plan);
+            return;
+        }
+
         AdjacencyList query_graph_ud;
         hash_map<std::string, uint> est_size;
         hash_map<std::string, uint> univariates;
+        // 变量的估计大小取它所在的三元组中最小的，0 也是有效的估计（结果为空）
+        auto estimate = [&est_size](const std::string& variable, uint size) {
+            auto it = est_size.find(variable);
+            if (it == est_size.end() || it->second > size)
+                est_size[variable] = size;
+        };
 
         for (size_t i = 0; i < triple_list.size(); ++i) {
             const auto& triple = triple_list[i];
@@ -124,21 +396,14 @@ class QueryPlan {
             std::string vertex1;
             uint edge;
             std::string vertex2;
-            uint size;
 
             if (s[0] == '?' && o[0] == '?') {
                 vertex1 = s;
                 edge = index->String2ID(p, Pos::kPredicate);
                 vertex2 = o;
                 // only support ?v predicate ?v
-                size = index->GetSSetSize(edge);
-                if (est_size[s] == 0 || est_size[s] > size) {
-                    est_size[s] = size;
-                }
-                size = index->GetOSetSize(edge);
-                if (est_size[o] == 0 || est_size[o] > size) {
-                    est_size[o] = size;
-                }
+                estimate(s, index->GetSSetSize(edge));
+                estimate(o, index->GetOSetSize(edge));
             } else if (s[0] == '?' && p[0] == '?') {
                 vertex1 = s;
                 edge = index->String2ID(o, Pos::kObject);
@@ -150,19 +415,13 @@ class QueryPlan {
             } else {
                 if (s[0] == '?') {
                     univariates[s] += 1;
-                    size = index->GetByPOSize(index->String2ID(p, Pos::kPredicate),
-                                              index->String2ID(o, Pos::kObject));
-                    if (est_size[s] == 0 || est_size[s] > size) {
-                        est_size[s] = size;
-                    }
+                    estimate(s, index->GetByPOSize(index->String2ID(p, Pos::kPredicate),
+                                                   index->String2ID(o, Pos::kObject)));
                 }
                 if (o[0] == '?') {
                     univariates[o] += 1;
-                    size = index->GetByPOSize(index->String2ID(p, Pos::kPredicate),
-                                              index->String2ID(o, Pos::kObject));
-                    if (est_size[s] == 0 || est_size[s] > size) {
-                        est_size[s] = size;
-                    }
+                    estimate(o, index->GetByPSSize(index->String2ID(p, Pos::kPredicate),
+                                                   index->String2ID(s, Pos::kSubject)));
                 }
                 if (p[0] == '?')
                     univariates[p] += 1;
@@ -276,7 +535,7 @@ class QueryPlan {
                     };
                 }
             }
-        } else {
+        } else if (!allPaths.empty()) {  // 只有单变量三元组时没有查询图，计划只由 univariates 组成
             phmap::flat_hash_set<std::string> exist_variables;
             for (auto& v : allPaths[longest_path]) {
                 exist_variables.insert(v);
@@ -358,6 +617,7 @@ class QueryPlan {
     void GenPlanTable(const std::shared_ptr<IndexRetriever>& index,
                       const std::vector<std::vector<std::string>>& triple_list,
                       std::vector<std::string>& variables) {
+        variables_ = variables;
         for (size_t i = 0; i < variables.size(); ++i) {
             variable_metadata_[variables[i]].first = i;
             if (debug_)
@@ -399,8 +659,9 @@ class QueryPlan {
                     item.search_code_ = index->String2ID(p, Pos::kPredicate);
                     // 下一步应该查询的变量的索引
                     item.candidate_result_idx_ = var_oid;
+                    item.candidate_item_idx_ = query_plan_[var_oid].size();
                     item.search_result_ = index->GetSSet(item.search_code_);
-                    item.search_result_->id = range_cnt;
+                    item.search_result_.id = range_cnt;
                     range_cnt += 1;
                     query_plan_[var_sid].push_back(item);
                     // 非 none 的 item 的索引
@@ -411,8 +672,7 @@ class QueryPlan {
                     candidate_result_item.search_type_ = Item::TypeT::kNone;
                     candidate_result_item.search_code_ = item.search_code_;  // don't have the search code
                     candidate_result_item.candidate_result_idx_ = 0;  // don't have the candidate result
-                    candidate_result_item.search_result_ =
-                        std::make_shared<Result>();  // initialize search range state
+                    candidate_result_item.search_result_ = Result();  // initialize search range state
                     query_plan_[var_oid].push_back(candidate_result_item);
                     // none item 的索引
                     none_type_indices_[var_oid].push_back(query_plan_[var_oid].size() - 1);
@@ -420,8 +680,9 @@ class QueryPlan {
                     item.search_code_ = index->String2ID(p, Pos::kPredicate);
                     item.search_type_ = Item::TypeT::kPS;
                     item.candidate_result_idx_ = var_sid;
+                    item.candidate_item_idx_ = query_plan_[var_sid].size();
                     item.search_result_ = index->GetOSet(item.search_code_);
-                    item.search_result_->id = range_cnt;
+                    item.search_result_.id = range_cnt;
                     range_cnt += 1;
                     query_plan_[var_oid].push_back(item);
                     other_type_indices_[var_oid].push_back(query_plan_[var_oid].size() - 1);
@@ -429,8 +690,7 @@ class QueryPlan {
                     candidate_result_item.search_type_ = Item::TypeT::kNone;
                     candidate_result_item.search_code_ = item.search_code_;  // don't have the search code
                     candidate_result_item.candidate_result_idx_ = 0;  // don't have the candidate result
-                    candidate_result_item.search_result_ =
-                        std::make_shared<Result>();  // initialize search range state
+                    candidate_result_item.search_result_ = Result();  // initialize search range state
                     query_plan_[var_sid].push_back(candidate_result_item);
                     none_type_indices_[var_sid].push_back(query_plan_[var_sid].size() - 1);
                 }
@@ -440,8 +700,8 @@ class QueryPlan {
                 variable_metadata_[s].second = Pos::kSubject;
                 uint oid = index->String2ID(o, Pos::kObject);
                 uint pid = index->String2ID(p, Pos::kPredicate);
-                std::shared_ptr<Result> r = index->GetByPO(pid, oid);
-                r->id = range_cnt;
+                Result r = index->GetByPO(pid, oid);
+                r.id = range_cnt;
                 prestore_result_[var_sid].push_back(r);
                 range_cnt++;
             }
@@ -450,13 +710,15 @@ class QueryPlan {
                 variable_metadata_[o].second = Pos::kObject;
                 uint sid = index->String2ID(s, Pos::kSubject);
                 uint pid = index->String2ID(p, Pos::kPredicate);
-                std::shared_ptr<Result> r = index->GetByPS(pid, sid);
-                r->id = range_cnt;
+                Result r = index->GetByPS(pid, sid);
+                r.id = range_cnt;
                 prestore_result_[var_oid].push_back(r);
                 range_cnt++;
             }
         }
 
+        BuildJoinTree(index, triple_list);
+
         if (debug_) {
             std::cout << "prestore_result_:" << std::endl;
             for (int level = 0; level < int(prestore_result_.size()); level++) {
@@ -465,7 +727,7 @@ class QueryPlan {
 
                 for (int i = 0; i < int(prestore_result_[level].size()); i++) {
                     std::cout << "[";
-                    std::cout << prestore_result_[level][i]->size();
+                    std::cout << prestore_result_[level][i].size();
 
                     // std::for_each(
                     //     _prestore_result_[level][i].first, _prestore_result_[level][i].second,
@@ -482,8 +744,8 @@ class QueryPlan {
             for (int i = 0; i < int(query_plan_.size()); i++) {
                 for (int j = 0; j < int(query_plan_[i].size()); j++) {
                     Item item = query_plan_[i][j];
-                    std::cout << item.search_result_->id << " [";
-                    std::cout << item.search_result_->size();
+                    std::cout << item.search_result_.id << " [";
+                    std::cout << item.search_result_.size();
                     std::cout << "] ";
                 }
                 std::cout << std::endl;
@@ -498,6 +760,70 @@ class QueryPlan {
         }
     }
 
+    // 查询图（双变量三元组连接的变量）是森林时，从每个连通分量中层数最小的变量开始广度优先遍历，
+    // 按照父节点在前的顺序记录连接树的边。两个变量之间有多个三元组时每个三元组各是一条边，它们不构成环；
+    // 主语和宾语是同一个变量的三元组只约束这个变量，不是边。有环或者有变量谓词时 semi_joins_ 为空
+    void BuildJoinTree(const std::shared_ptr<IndexRetriever>& index,
+                       const std::vector<std::vector<std::string>>& triple_list) {
+        semi_joins_.clear();
+        size_t n = variables_.size();
+        // 层 -> (相邻的层, 谓词, 这一层的变量在三元组中的位置)
+        std::vector<std::vector<std::tuple<size_t, uint, Pos>>> adjacency(n);
+        std::vector<size_t> component(n);
+        std::iota(component.begin(), component.end(), 0);
+        std::function<size_t(size_t)> find = [&](size_t v) {
+            return component[v] == v ? v : component[v] = find(component[v]);
+        };
+        phmap::flat_hash_set<uint64_t> pairs;
+
+        for (const auto& triple : triple_list) {
+            const std::string& s = triple[0];
+            const std::string& p = triple[1];
+            const std::string& o = triple[2];
+            if (p[0] == '?')
+                return;
+            if (s[0] != '?' || o[0] != '?' || s == o)
+                continue;
+
+            size_t a = variable_metadata_.at(s).first;
+            size_t b = variable_metadata_.at(o).first;
+            uint pid = index->String2ID(p, Pos::kPredicate);
+            adjacency[a].emplace_back(b, pid, Pos::kSubject);
+            adjacency[b].emplace_back(a, pid, Pos::kObject);
+            if (!pairs.insert(uint64_t(std::min(a, b)) << 32 | std::max(a, b)).second)
+                continue;
+            if (find(a) == find(b))
+                return;
+            component[find(a)] = find(b);
+        }
+
+        std::vector<SemiJoin> semi_joins;
+        std::vector<size_t> parent(n, n);
+        std::vector<bool> visited(n, false);
+        for (size_t root = 0; root < n; root++) {
+            if (visited[root])
+                continue;
+            visited[root] = true;
+            std::vector<size_t> queue = {root};
+            for (size_t i = 0; i < queue.size(); i++) {
+                size_t u = queue[i];
+                for (const auto& [w, pid, pos] : adjacency[u]) {
+                    if (!visited[w]) {
+                        visited[w] = true;
+                        parent[w] = u;
+                        queue.push_back(w);
+                    }
+                    if (parent[w] == u)
+                        semi_joins.push_back({u, w, pid, pos});
+                }
+            }
+        }
+        semi_joins_ = std::move(semi_joins);
+    }
+
+    // 无环查询的连接树的边，父节点在前，见 BuildJoinTree
+    [[nodiscard]] const std::vector<SemiJoin>& semi_joins() const { return semi_joins_; }
+
     [[nodiscard]] const hash_map<std::string, std::pair<uint, Pos>>& variable_metadata() const {
         return variable_metadata_;
     }
@@ -511,14 +837,302 @@ class QueryPlan {
         return ret;
     }
 
+    // 复制这个计划，并按照 triple_list 重新查找单变量三元组的结果。
+    // triple_list 与生成计划的三元组只能在单变量三元组的常量上不同（见 PlanCache::Template）
+    std::shared_ptr<QueryPlan> Rebind(const std::shared_ptr<IndexRetriever>& index,
+                                      const std::vector<std::vector<std::string>>& triple_list,
+                                      size_t limit,
+                                      size_t offset = 0,
+                                      std::vector<std::pair<std::string, bool>> order_by = {}) const {
+        auto plan = std::make_shared<QueryPlan>(*this);
+        plan->limit_ = limit;
+        plan->offset_ = offset;
+        plan->order_by_ = std::move(order_by);
+        plan->triple_list_ = triple_list;
+        for (auto& results : plan->prestore_result_) {
+            results.clear();
+        }
+
+        // 与 GenPlanTable 相同的顺序编号
+        int range_cnt = 0;
+        for (const auto& triple : triple_list) {
+            const std::string& s = triple[0];
+            const std::string& p = triple[1];
+            const std::string& o = triple[2];
+
+            if (p[0] == '?')
+                continue;
+            if (s[0] == '?' && o[0] == '?') {
+                range_cnt++;
+            } else if (s[0] == '?') {
+                Result r = index->GetByPO(index->String2ID(p, Pos::kPredicate), index->String2ID(o, Pos::kObject));
+                r.id = range_cnt++;
+                plan->prestore_result_[variable_metadata_.at(s).first].push_back(r);
+            } else if (o[0] == '?') {
+                Result r = index->GetByPS(index->String2ID(p, Pos::kPredicate), index->String2ID(s, Pos::kSubject));
+                r.id = range_cnt++;
+                plan->prestore_result_[variable_metadata_.at(o).first].push_back(r);
+            }
+        }
+        return plan;
+    }
+
+    // 执行时第 0 层的前一部分实体已经处理完，bindings[i] 是平均每个处理过的第 0 层候选实体在第 i 层得到的绑定个数，
+    // first_size 是还没有处理的第 0 层候选实体个数。第 0 层的变量保持不变，用观察到的中间结果大小重新选择其余变量的顺序，
+    // 顺序不变时返回空
+    std::shared_ptr<QueryPlan> Replan(const std::shared_ptr<IndexRetriever>& index,
+                                      const std::vector<double>& bindings,
+                                      double first_size) const {
+        Feedback feedback{variables_, bindings, first_size};
+        auto plan = std::make_shared<QueryPlan>(*this);
+        std::vector<std::string> variables = plan->CostBasedOrder(index, triple_list_, &feedback);
+        if (variables.empty() || variables == variables_)
+            return nullptr;
+
+        plan->query_plan_.clear();
+        plan->prestore_result_.clear();
+        plan->other_type_indices_.clear();
+        plan->none_type_indices_.clear();
+        plan->variable_metadata_.clear();
+        plan->GenPlanTable(index, triple_list_, variables);
+        return plan;
+    }
+
+    // 变量按照层的顺序排列
+    [[nodiscard]] const std::vector<std::string>& variables() const { return variables_; }
+
+    // 第 i 层平均每个第 0 层实体的绑定个数的估计，没有统计信息时为空
+    [[nodiscard]] const std::vector<double>& estimated_bindings() const { return estimated_bindings_; }
+
     [[nodiscard]] const std::vector<std::vector<Item>>& query_plan() const { return query_plan_; }
 
     size_t limit_;
+    size_t offset_;
+    // (variable, is descending)
+    std::vector<std::pair<std::string, bool>> order_by_;
     std::vector<std::vector<size_t>> other_type_indices_;
     std::vector<std::vector<size_t>> none_type_indices_;
-    std::vector<std::vector<std::shared_ptr<Result>>> prestore_result_;
+    std::vector<std::vector<Result>> prestore_result_;
 
    private:
+    // 变量个数不超过它时用动态规划选择变量的顺序，需要 2^n 的空间
+    static constexpr size_t kMaxDPVariables = 14;
+    // 每个变量最多采样的候选实体个数
+    static constexpr uint kSampleSize = 256;
+    // 采样连接时每个实体最多查看的相邻实体个数
+    static constexpr uint kNeighborSampleSize = 16;
+
+    // 双变量三元组 (?s p ?o)，s_edge_、o_edge_ 是它在两个变量的 edges 中的位置
+    struct Join {
+        uint sid_;
+        uint oid_;
+        uint pid_;
+        size_t s_edge_;
+        size_t o_edge_;
+    };
+
+    // 变量所在的一个三元组：变量是谓词 pid_ 的主语或宾语，另一端是常量 constant_ 或者变量（constant_ 为 0）
+    struct Constraint {
+        Pos pos_;
+        uint pid_;
+        uint constant_;
+    };
+
+    // 在 sampling_budget_ 微秒内用采样修正统计信息的估计，统计信息无法反映谓词之间的相关性：
+    // 1. 从每个变量最短的候选列表（谓词的 S/O 集合或者单变量三元组的结果）中均匀地取最多 kSampleSize 个实体，
+    //    检查它们是否满足变量的其他三元组，估计变量在第 0 层的候选集合大小；
+    // 2. 对每个双变量三元组，从候选集合较小的一端满足条件的样本出发，用 GetByPS/GetByPO 取相邻实体，
+    //    检查它们是否满足另一端变量的三元组以及两个变量之间的其他三元组，估计两个变量连接后的大小。
+    // 超时后还没有采样完的变量和三元组保留原来的估计
+    void Sample(const std::shared_ptr<IndexRetriever>& index,
+                const std::vector<std::vector<Constraint>>& constraints,
+                const std::vector<Join>& joins,
+                std::vector<double>& domain,
+                std::vector<std::vector<std::pair<uint, double>>>& edges) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(sampling_budget_);
+        auto expired = [&deadline]() { return std::chrono::steady_clock::now() > deadline; };
+
+        size_t n = domain.size();
+        std::vector<std::vector<uint>> survivors(n);
+        std::vector<bool> sampled(n, false);
+        for (uint v = 0; v < n && !expired(); v++) {
+            // 统计信息已经确定为空（谓词或常量不存在）的变量不需要采样
+            if (domain[v] == 0) {
+                sampled[v] = true;
+                continue;
+            }
+            // 最短的候选列表
+            size_t shortest = 0;
+            uint shortest_size = UINT_MAX;
+            for (size_t i = 0; i < constraints[v].size(); i++) {
+                uint size = CandidateSize(index, constraints[v][i]);
+                if (size < shortest_size) {
+                    shortest = i;
+                    shortest_size = size;
+                }
+            }
+            Result candidates = Candidates(index, constraints[v][shortest]);
+            uint size = candidates.size();
+            uint step = std::max<uint>(1, size / kSampleSize);
+            uint total = 0;
+            bool finished = true;
+            for (uint i = 0; i < size; i += step, total++) {
+                if (expired()) {
+                    finished = false;
+                    break;
+                }
+                uint entity = candidates[i];
+                bool match = true;
+                for (size_t c = 0; c < constraints[v].size() && match; c++) {
+                    if (c != shortest)
+                        match = Satisfies(index, constraints[v][c], entity);
+                }
+                if (match)
+                    survivors[v].push_back(entity);
+            }
+            if (!finished)
+                break;
+
+            sampled[v] = true;
+            if (step == 1) {
+                domain[v] = survivors[v].size();
+            } else {
+                // 没有样本满足条件时按半个样本估计，避免把不确定的变量估计为空
+                double matched = survivors[v].empty() ? 0.5 : survivors[v].size();
+                domain[v] = matched / total * size;
+            }
+        }
+
+        std::vector<bool> handled(joins.size(), false);
+        for (size_t j = 0; j < joins.size() && !expired(); j++) {
+            const Join& join = joins[j];
+            if (handled[j] || !sampled[join.sid_] || !sampled[join.oid_])
+                continue;
+            // 从候选集合较小的一端出发
+            bool from_subject = domain[join.sid_] <= domain[join.oid_];
+            uint from = from_subject ? join.sid_ : join.oid_;
+            uint to = from_subject ? join.oid_ : join.sid_;
+            if (survivors[from].empty())
+                continue;
+
+            // 两个变量之间的其他三元组一起采样，它们的选择率已经包含在这个三元组中
+            std::vector<size_t> parallel;
+            for (size_t k = j + 1; k < joins.size(); k++) {
+                if ((joins[k].sid_ == join.sid_ && joins[k].oid_ == join.oid_) ||
+                    (joins[k].sid_ == join.oid_ && joins[k].oid_ == join.sid_))
+                    parallel.push_back(k);
+            }
+
+            double pairs = 0;
+            bool finished = true;
+            for (uint entity : survivors[from]) {
+                if (expired()) {
+                    finished = false;
+                    break;
+                }
+                Result neighbors =
+                    from_subject ? index->GetByPS(join.pid_, entity) : index->GetByPO(join.pid_, entity);
+                uint size = neighbors.size();
+                uint step = std::max<uint>(1, size / kNeighborSampleSize);
+                uint total = 0;
+                uint matched = 0;
+                for (uint i = 0; i < size; i += step, total++) {
+                    uint neighbor = neighbors[i];
+                    bool match = true;
+                    for (const auto& constraint : constraints[to]) {
+                        if (!match)
+                            break;
+                        match = Satisfies(index, constraint, neighbor);
+                    }
+                    for (size_t k : parallel) {
+                        if (!match)
+                            break;
+                        uint s = joins[k].sid_ == from ? entity : neighbor;
+                        uint o = joins[k].sid_ == from ? neighbor : entity;
+                        match = Contains(index->GetByPS(joins[k].pid_, s), o);
+                    }
+                    matched += match;
+                }
+                if (total)
+                    pairs += 1.0 * matched / total * size;
+            }
+            if (!finished)
+                break;
+
+            // 连接的大小 = 出发端的候选集合大小 * 每个候选实体平均连接的实体个数
+            double card = domain[from] * pairs / survivors[from].size();
+            double product = domain[join.sid_] * domain[join.oid_];
+            double selectivity = product > 0 ? std::min(1.0, card / product) : 0;
+            edges[join.sid_][join.s_edge_].second = selectivity;
+            edges[join.oid_][join.o_edge_].second = selectivity;
+            for (size_t k : parallel) {
+                handled[k] = true;
+                edges[joins[k].sid_][joins[k].s_edge_].second = 1;
+                edges[joins[k].oid_][joins[k].o_edge_].second = 1;
+            }
+        }
+
+        if (debug_) {
+            std::cout << "sampled domain:";
+            for (uint v = 0; v < n; v++) {
+                std::cout << " " << domain[v] << (sampled[v] ? "" : "?");
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    static uint CandidateSize(const std::shared_ptr<IndexRetriever>& index, const Constraint& constraint) {
+        if (constraint.constant_ == 0)
+            return constraint.pos_ == Pos::kSubject ? index->GetSSetSize(constraint.pid_)
+                                                    : index->GetOSetSize(constraint.pid_);
+        return constraint.pos_ == Pos::kSubject ? index->GetByPOSize(constraint.pid_, constraint.constant_)
+                                                : index->GetByPSSize(constraint.pid_, constraint.constant_);
+    }
+
+    // 满足这个三元组的所有实体，升序
+    static Result Candidates(const std::shared_ptr<IndexRetriever>& index, const Constraint& constraint) {
+        if (constraint.pid_ == 0 || constraint.pid_ > index->predicate_cnt())
+            return Result();
+        if (constraint.constant_ == 0)
+            return constraint.pos_ == Pos::kSubject ? index->GetSSet(constraint.pid_)
+                                                    : index->GetOSet(constraint.pid_);
+        return constraint.pos_ == Pos::kSubject ? index->GetByPO(constraint.pid_, constraint.constant_)
+                                                : index->GetByPS(constraint.pid_, constraint.constant_);
+    }
+
+    static bool Satisfies(const std::shared_ptr<IndexRetriever>& index, const Constraint& constraint, uint entity) {
+        if (constraint.constant_ == 0)
+            return constraint.pos_ == Pos::kSubject ? index->GetByPSSize(constraint.pid_, entity) > 0
+                                                    : index->GetByPOSize(constraint.pid_, entity) > 0;
+        return constraint.pos_ == Pos::kSubject
+                   ? Contains(index->GetByPS(constraint.pid_, entity), constraint.constant_)
+                   : Contains(index->GetByPO(constraint.pid_, entity), constraint.constant_);
+    }
+
+    // 在升序的 Result 中二分查找
+    static bool Contains(const Result& result, uint value) {
+        uint low = 0, high = result.size();
+        while (low < high) {
+            uint mid = low + (high - low) / 2;
+            uint current = result[mid];
+            if (current == value)
+                return true;
+            if (current < value)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+        return false;
+    }
+
+    // 生成计划时采样估计基数的时间（微秒），0 表示只使用统计信息
+    uint32_t sampling_budget_ = 0;
+
+    std::vector<std::vector<std::string>> triple_list_;
+    std::vector<std::string> variables_;
+    std::vector<double> estimated_bindings_;
+    std::vector<SemiJoin> semi_joins_;
+
     bool debug_ = false;
     // 二维数组，变量的优先级顺序id -> 此变量在不同的三元组中的查询结果
     std::vector<std::vector<Item>> query_plan_;
@@ -2,36 +2,53 @@
 #ifndef QUERY_RESULT_HPP
 #define QUERY_RESULT_HPP
 
+#include <parallel_hashmap/phmap.h>
+#include <cstring>
 #include <nlohmann/json.hpp>
+#include <string>
 #include <vector>
 #include "../parser/sparql_parser.hpp"
 #include "../store/index_retriever.hpp"
 #include "./query_plan.hpp"
 
+// DISTINCT：删除 columns 中的列都相同的重复行，保留第一次出现的行，其余行的顺序不变。
+// 结果中相同的行不一定相邻（实体 id 与字符串的顺序无关），所以用哈希集合判断是否出现过
+void distinct_rows(std::vector<std::vector<uint>>& rows, const std::vector<std::pair<uint, Pos>>& columns) {
+    phmap::flat_hash_set<std::string> seen;
+    seen.reserve(rows.size());
+    std::string key(columns.size() * sizeof(uint), '\0');
+    size_t kept = 0;
+    for (size_t r = 0; r < rows.size(); r++) {
+        for (size_t i = 0; i < columns.size(); i++) {
+            std::memcpy(&key[i * sizeof(uint)], &rows[r][columns[i].first], sizeof(uint));
+        }
+        if (!seen.insert(key).second)
+            continue;
+        if (kept != r)
+            rows[kept] = std::move(rows[r]);
+        kept++;
+    }
+    rows.erase(rows.begin() + kept, rows.end());
+}
+
 uint query_result(std::vector<std::vector<uint>>& results_id,
                   std::vector<std::vector<std::string>>& results_str,
                   const std::shared_ptr<IndexRetriever> index,
                   const std::vector<std::pair<uint, Pos>> variable_indexes,
                   const std::shared_ptr<SPARQLParser> parser) {
-    auto last = results_id.end();
     const auto& modifier = parser->project_modifier();
     // 获取每一个变量的id（优先级顺序）
 
-    if (modifier.modifier_type_ == SPARQLParser::ProjectModifier::Distinct) {
-        last = std::unique(results_id.begin(), results_id.end(),
-                           [&](const std::vector<uint>& a, const std::vector<uint>& b) {
-                               return std::all_of(
-                                   variable_indexes.begin(), variable_indexes.end(),
-                                   [&](std::pair<uint, Pos> i) { return a[i.first] == b[i.first]; });
-                           });
-    }
+    if (modifier.modifier_type_ == SPARQLParser::ProjectModifier::Distinct)
+        distinct_rows(results_id, variable_indexes);
 
     uint r_id = 0;
-    for (auto it = results_id.begin(); it != last; ++it) {
+    std::string scratch;
+    for (auto it = results_id.begin(); it != results_id.end(); ++it) {
         const auto& item = *it;
         uint i = 0;
         for (const auto& idx : variable_indexes) {
-            results_str[r_id][i] = index->ID2String(item[idx.first], idx.second);
+            results_str[r_id][i] = index->ID2String(item[idx.first], idx.second, scratch);
             i++;
         }
         r_id++;
@@ -44,7 +61,6 @@ int query_result(std::vector<std::vector<uint>>& result,
                  const std::shared_ptr<IndexRetriever> index,
                  const std::shared_ptr<QueryPlan> query_plan,
                  const std::shared_ptr<SPARQLParser> parser) {
-    auto last = result.end();
     const auto& modifier = parser->project_modifier();
     // project_variables 是要输出的变量顺序
     // 而 result 的变量顺序是计划生成中的变量排序
@@ -52,21 +68,13 @@ int query_result(std::vector<std::vector<uint>>& result,
     const auto variable_indexes = query_plan->MappingVariable(parser->ProjectVariables());
 
     int cnt = 0;
-    if (modifier.modifier_type_ == SPARQLParser::ProjectModifier::Distinct) {
-        last = std::unique(result.begin(), result.end(),
-                           // 判断两个列表 a 和 b 是否相同，
-                           [&](const std::vector<uint>& a, const std::vector<uint>& b) {
-                               // std::all_of 可以用来判断数组中的值是否都满足一个条件
-                               return std::all_of(
-                                   variable_indexes.begin(), variable_indexes.end(),
-                                   // 判断依据是，列表中的每一个元素都相同
-                                   [&](std::pair<uint, Pos> i) { return a[i.first] == b[i.first]; });
-                           });
-    }
-    for (auto it = result.begin(); it != last; ++it) {
+    if (modifier.modifier_type_ == SPARQLParser::ProjectModifier::Distinct)
+        distinct_rows(result, variable_indexes);
+    std::string scratch;
+    for (auto it = result.begin(); it != result.end(); ++it) {
         const auto& item = *it;
         for (const auto& idx : variable_indexes) {
-            std::cout << index->ID2String(item[idx.first], idx.second) << " ";
+            std::cout << index->ID2String(item[idx.first], idx.second, scratch) << " ";
         }
         cnt++;
         std::cout << "\n";
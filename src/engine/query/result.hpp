@@ -2,40 +2,34 @@
 #define RESULT_LIST_HPP
 
 #include <iterator>
+#include <memory>
 #include <string>
+#include <type_traits>
 #include <vector>
-#include <memory>
 
 
 class ResultList {
    public:
+    // 一个升序 id 列表的只读视图：指向索引文件的映射或者调用者持有的数组，不拥有数据，
+    // 可以直接按值复制，查找时不需要分配内存。调用者需要保证数组在视图使用期间有效
     class Result {
-        uint* start_;
+        const uint* start_;
         uint size_;
-        bool in_mem_ = false;
 
        public:
         int id = -1;
         Result() : start_(nullptr), size_(0) {}
 
-        Result(uint* start, uint size) : start_(start), size_(size) {}
-
-        Result(uint* start, uint size, bool in_mem) : start_(start), size_(size), in_mem_(in_mem) {}
-
-        ~Result() {
-            if (in_mem_ && start_) {
-                delete[] start_;  // 释放数组
-                start_ = nullptr;
-            }
-        }
+        Result(const uint* start, uint size) : start_(start), size_(size) {}
 
         class Iterator {
-            uint* ptr_;
+            const uint* ptr_;
 
            public:
             Iterator() : ptr_(nullptr) {}
-            Iterator(uint* p) : ptr_(p) {}
+            Iterator(const uint* p) : ptr_(p) {}
             Iterator(const Iterator& it) : ptr_(it.ptr_) {}
+            Iterator& operator=(const Iterator& it) = default;
 
             Iterator& operator++() {
                 ++ptr_;
@@ -52,19 +46,21 @@ class ResultList {
             bool operator==(const Iterator& rhs) const { return ptr_ == rhs.ptr_; }
             bool operator!=(const Iterator& rhs) const { return ptr_ != rhs.ptr_; }
             bool operator<(const Iterator& rhs) const { return ptr_ < rhs.ptr_; }
-            uint& operator*() { return *ptr_; }
+            const uint& operator*() const { return *ptr_; }
         };
 
-        Iterator begin() { return Iterator(start_); }
-        Iterator end() { return Iterator(start_ + size_); }
-        uint& operator[](uint i) {
-            if (i >= 0 && i < size_) {
+        Iterator begin() const { return Iterator(start_); }
+        Iterator end() const { return Iterator(start_ + size_); }
+        uint operator[](uint i) const {
+            if (i < size_) {
                 return *(start_ + i);
             }
             return *start_;
         }
 
-        uint size() { return size_; }
+        const uint* data() const { return start_; }
+
+        uint size() const { return size_; }
     };
 
     void Clear() {
@@ -74,43 +70,43 @@ class ResultList {
 
     void Sizes() {
         for (long unsigned int i = 0; i < results_.size(); i++) {
-            std::cout << results_[i]->size() << " ";
+            std::cout << results_[i].size() << " ";
         }
         std::cout << std::endl;
     }
 
-    ResultList() { results_ = std::vector<std::shared_ptr<Result>>(); }
+    ResultList() {}
 
-    bool AddVectors(std::vector<std::shared_ptr<Result>> ranges) {
-        for (std::vector<std::shared_ptr<Result>>::iterator it = ranges.begin(); it != ranges.end(); it++) {
-            if ((*it)->size() == 0)
+    bool AddVectors(const std::vector<Result>& ranges) {
+        for (const auto& range : ranges) {
+            if (range.size() == 0)
                 return 0;
-            AddVector(*it);
+            AddVector(range);
         }
         return 1;
     }
 
-    std::shared_ptr<Result> Shortest() {
+    const Result& Shortest() {
         long unsigned int min_i = 0;
-        long unsigned int min = results_[0]->size();
+        long unsigned int min = results_[0].size();
         for (long unsigned int i = 0; i < results_.size(); i++) {
-            if (results_[i]->size() < min) {
-                min = results_[i]->size();
+            if (results_[i].size() < min) {
+                min = results_[i].size();
                 min_i = i;
             }
         }
         return results_[min_i];
     }
 
-    void AddVector(std::shared_ptr<Result> range) {
+    void AddVector(const Result& range) {
         if (results_.size() == 0) {
             results_.push_back(range);
             return;
         }
 
-        uint first_val = range->operator[](0);
+        uint first_val = range[0];
         for (long unsigned int i = 0; i < results_.size(); i++) {
-            if (results_[i]->operator[](0) > first_val) {
+            if (results_[i][0] > first_val) {
                 results_.insert(results_.begin() + i, range);
                 return;
             }
@@ -121,15 +117,13 @@ class ResultList {
 
     void UpdateCurrentPostion() {
         for (long unsigned int i = 0; i < results_.size(); i++) {
-            vector_current_pos_.push_back(results_[i]->begin());
+            vector_current_pos_.push_back(results_[i].begin());
         }
     }
 
     void Seek(int i, uint val) {
-        std::shared_ptr<Result> p_r = results_[i];
-
         auto it = vector_current_pos_[i];
-        auto end = p_r->end();
+        auto end = results_[i].end();
         for (; it < end; it = it + 2) {
             if (*it >= val) {
                 if (*(it - 1) >= val) {
@@ -155,11 +149,11 @@ class ResultList {
     // 更新range的起始迭代器
     void NextVal(int i) { vector_current_pos_[i]++; }
 
-    std::shared_ptr<Result> GetRangeByIndex(int i) { return results_[i]; }
+    const Result& GetRangeByIndex(int i) { return results_[i]; }
 
     bool HasEmpty() {
         for (long unsigned int i = 0; i < results_.size(); i++) {
-            if (results_[i]->size() == 0) {
+            if (results_[i].size() == 0) {
                 return true;
             }
         }
@@ -167,16 +161,17 @@ class ResultList {
     }
 
     bool AtEnd(int i) {
-        std::shared_ptr<Result> p_r = results_[i];
-        return vector_current_pos_[i] == p_r->end();
+        return vector_current_pos_[i] == results_[i].end();
     }
 
     int Size() { return results_.size(); }
 
    private:
-    std::vector<std::shared_ptr<Result>> results_;
+    std::vector<Result> results_;
 
     std::vector<Result::Iterator> vector_current_pos_;
 };
 
+static_assert(std::is_trivially_copyable_v<ResultList::Result>, "Result is passed by value on the query path");
+
 #endif
\ No newline at end of file
@@ -0,0 +1,150 @@
+#ifndef RESULT_CACHE_HPP
+#define RESULT_CACHE_HPP
+
+#include <atomic>
+#include <cctype>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../store/index_retriever.hpp"
+
+// 按照查询文本缓存完整的查询结果，保存的是 id（聚合查询是字符串），返回前才解码。
+// 缓存按照结果占用的字节数淘汰最久没有使用的结果，超过容量 1/kAdmitRatio 的结果不缓存，
+// 避免一个大结果把缓存清空。超时或超过内存上限的查询结果不完整，不缓存
+class ResultCache {
+   public:
+    static constexpr size_t kAdmitRatio = 4;
+
+    struct Entry {
+        std::vector<std::vector<uint>> rows_;
+        // 每个投影变量在 rows_ 中的 (位置, Pos)，id 为 0 表示变量没有绑定
+        std::vector<std::pair<uint, Pos>> columns_;
+        // 聚合查询的结果
+        std::vector<std::vector<std::string>> strings_;
+
+        size_t bytes() const {
+            size_t bytes = sizeof(Entry) + columns_.size() * sizeof(std::pair<uint, Pos>);
+            for (const auto& row : rows_) {
+                bytes += sizeof(row) + row.size() * sizeof(uint);
+            }
+            for (const auto& row : strings_) {
+                bytes += sizeof(row) + row.size() * sizeof(std::string);
+                for (const auto& str : row) {
+                    bytes += str.size();
+                }
+            }
+            return bytes;
+        }
+
+        size_t size() const { return strings_.empty() ? rows_.size() : strings_.size(); }
+    };
+
+    // capacity 是缓存可以使用的字节数，0 表示不缓存
+    explicit ResultCache(size_t capacity) : capacity_(capacity) {}
+
+    std::shared_ptr<const Entry> Get(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key);
+        if (it == entries_.end()) {
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return it->second->entry_;
+    }
+
+    void Put(const std::string& key, const std::shared_ptr<const Entry>& entry) {
+        size_t bytes = entry->bytes() + key.size();
+        if (bytes > capacity_ / kAdmitRatio)
+            return;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (entries_.count(key))
+            return;
+        lru_.push_front({key, entry, bytes});
+        entries_[key] = lru_.begin();
+        bytes_ += bytes;
+        while (bytes_ > capacity_) {
+            bytes_ -= lru_.back().bytes_;
+            entries_.erase(lru_.back().key_);
+            lru_.pop_back();
+        }
+    }
+
+    void Clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.clear();
+        lru_.clear();
+        bytes_ = 0;
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return lru_.size();
+    }
+
+    size_t bytes() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return bytes_;
+    }
+
+    size_t capacity() const { return capacity_; }
+
+    size_t hits() const { return hits_.load(std::memory_order_relaxed); }
+
+    size_t misses() const { return misses_.load(std::memory_order_relaxed); }
+
+    // 合并 IRI 和字符串之外的连续空白，去掉首尾的空白
+    static std::string Normalize(const std::string& sparql) {
+        std::string normalized;
+        normalized.reserve(sparql.size());
+        char quote = 0;
+        bool space = false;
+        for (size_t i = 0; i < sparql.size(); i++) {
+            char c = sparql[i];
+            if (quote) {
+                normalized += c;
+                if (c == quote)
+                    quote = 0;
+                continue;
+            }
+            if (std::isspace(static_cast<unsigned char>(c))) {
+                space = true;
+                continue;
+            }
+            if (space && !normalized.empty())
+                normalized += ' ';
+            space = false;
+            // 与 SPARQLLexer 相同，'<' 后面是空白或 '=' 时是比较运算符
+            if (c == '"')
+                quote = '"';
+            else if (c == '<' && i + 1 < sparql.size() && sparql[i + 1] != '=' &&
+                     !std::isspace(static_cast<unsigned char>(sparql[i + 1])))
+                quote = '>';
+            normalized += c;
+        }
+        return normalized;
+    }
+
+   private:
+    struct Node {
+        std::string key_;
+        std::shared_ptr<const Entry> entry_;
+        size_t bytes_;
+    };
+
+    std::mutex mutex_;
+    size_t capacity_;
+    size_t bytes_ = 0;
+    std::list<Node> lru_;  // 最近使用的在前面
+    hash_map<std::string, std::list<Node>::iterator> entries_;
+    std::atomic<size_t> hits_{0};
+    std::atomic<size_t> misses_{0};
+};
+
+#endif  // RESULT_CACHE_HPP
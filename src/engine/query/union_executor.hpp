@@ -0,0 +1,213 @@
+#ifndef UNION_EXECUTOR_HPP
+#define UNION_EXECUTOR_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "../parser/sparql_parser.hpp"
+#include "../store/index_retriever.hpp"
+#include "../tools/thread_pool.hpp"
+#include "order_by.hpp"
+#include "plan_cache.hpp"
+#include "query_executor.hpp"
+#include "query_guard.hpp"
+#include "query_plan.hpp"
+
+// 执行带有 UNION 的查询：每一个分支生成自己的 QueryPlan，由自己的 QueryExecutor 执行，
+// 分支的结果按照投影变量的顺序合并
+class UnionExecutor {
+   public:
+    UnionExecutor(const std::shared_ptr<IndexRetriever>& p_index,
+                  const std::shared_ptr<SPARQLParser>& p_parser)
+        : _p_index(p_index), _p_parser(p_parser) {}
+
+    void Query() {
+        _query_begin_time = std::chrono::high_resolution_clock::now();
+
+        // ORDER BY 中没有被投影的变量作为隐藏的列放在投影变量之后，合并排序后删除
+        std::vector<std::string> variables = _p_parser->ProjectVariables();
+        size_t project_cnt = variables.size();
+        for (const auto& order : _p_parser->OrderBy()) {
+            if (std::find(variables.begin(), variables.end(), order.first) == variables.end())
+                variables.push_back(order.first);
+        }
+
+        auto triple_lists = _p_parser->TripleLists();
+        size_t n = triple_lists.size();
+
+        // 每个分支最多需要 offset + limit 个结果，OFFSET 在合并时处理。
+        // DISTINCT 在合并时才去重，分支中重复的行不能计入 LIMIT，此时分支不限制结果数量
+        bool distinct =
+            _p_parser->project_modifier().modifier_type_ == SPARQLParser::ProjectModifier::Distinct;
+        size_t limit = distinct ? UINTMAX_MAX : _p_parser->Limit();
+        if (limit != UINTMAX_MAX)
+            limit += _p_parser->Offset();
+
+        // 查询计划在当前线程中依次获取，分支之后在线程池中并行执行
+        std::vector<std::shared_ptr<QueryPlan>> plans;
+        for (const auto& triple_list : triple_lists) {
+            if (_plan_cache)
+                plans.push_back(_plan_cache->Get(_p_index, triple_list, limit, 0, _p_parser->OrderBy()));
+            else
+                plans.push_back(
+                    std::make_shared<QueryPlan>(_p_index, triple_list, limit, 0, _p_parser->OrderBy()));
+        }
+
+        _variable_positions.assign(variables.size(), Pos::kSubject);
+        std::vector<bool> position_set(variables.size(), false);
+        for (const auto& plan : plans) {
+            const auto& metadata = plan->variable_metadata();
+            for (size_t i = 0; i < variables.size(); i++) {
+                auto it = metadata.find(variables[i]);
+                if (!position_set[i] && it != metadata.end()) {
+                    _variable_positions[i] = it->second.second;
+                    position_set[i] = true;
+                }
+            }
+        }
+
+        std::vector<std::vector<std::vector<uint>>> branch_results(n);
+        auto execute_branch = [&](size_t branch) {
+            QueryExecutor executor(_p_index, plans[branch]);
+            executor.SetGuard(_guard);
+            executor.Query();
+            Project(variables, plans[branch], executor.query_result(), branch_results[branch]);
+            // 分支的结果被复制到投影后的行中，执行器的结果随后释放
+            if (_guard)
+                _guard->AddMemory(RowsBytes(branch_results[branch]) - RowsBytes(executor.query_result()));
+        };
+
+        if (n == 1 || !_thread_pool) {
+            for (size_t branch = 0; branch < n; branch++) {
+                execute_branch(branch);
+            }
+        } else {
+            BS::multi_future<void> futures;
+            for (size_t branch = 0; branch < n; branch++) {
+                futures.push_back(_thread_pool->submit(execute_branch, branch));
+            }
+            futures.get();
+        }
+
+        if (_guard && _guard->MemoryExceeded()) {
+            _variable_positions.resize(project_cnt);
+            _query_end_time = std::chrono::high_resolution_clock::now();
+            return;
+        }
+
+        std::vector<OrderBy::Column> columns;
+        for (const auto& [variable, descending] : _p_parser->OrderBy()) {
+            uint column = std::find(variables.begin(), variables.end(), variable) - variables.begin();
+            columns.push_back({column, _variable_positions[column], descending});
+        }
+        _order_by = OrderBy(_p_index, std::move(columns));
+
+        Merge(branch_results, project_cnt);
+
+        _variable_positions.resize(project_cnt);
+
+        _query_end_time = std::chrono::high_resolution_clock::now();
+    }
+
+    void SetGuard(const std::shared_ptr<QueryGuard>& guard) { _guard = guard; }
+
+    // 分支的查询计划从 plan_cache 中获取
+    void SetPlanCache(const std::shared_ptr<PlanCache>& plan_cache) { _plan_cache = plan_cache; }
+
+    // 分支在共享的线程池中执行，没有设置时依次执行
+    void SetThreadPool(const std::shared_ptr<BS::thread_pool>& thread_pool) { _thread_pool = thread_pool; }
+
+    bool Stopped() const { return _guard && _guard->Stopped(); }
+
+    inline double Duration() {
+        return static_cast<std::chrono::duration<double, std::milli>>(_query_end_time - _query_begin_time)
+            .count();
+    }
+
+    // 每一行按照 ProjectVariables 的顺序排列，分支中没有绑定的变量为 0
+    [[nodiscard]] std::vector<std::vector<uint>>& query_result() { return _result; }
+
+    [[nodiscard]] const std::vector<Pos>& variable_positions() const { return _variable_positions; }
+
+   private:
+    void Project(const std::vector<std::string>& variables,
+                 const std::shared_ptr<QueryPlan>& plan,
+                 const std::vector<std::vector<uint>>& tuples,
+                 std::vector<std::vector<uint>>& rows) {
+        // 投影变量在此分支的结果中的位置，-1 表示此分支没有这个变量
+        std::vector<int> indexes;
+        const auto& metadata = plan->variable_metadata();
+        for (const auto& var : variables) {
+            auto it = metadata.find(var);
+            indexes.push_back(it == metadata.end() ? -1 : int(it->second.first));
+        }
+
+        rows.reserve(tuples.size());
+        for (const auto& tuple : tuples) {
+            std::vector<uint> row(indexes.size(), 0);
+            for (size_t i = 0; i < indexes.size(); i++) {
+                if (indexes[i] != -1)
+                    row[i] = tuple[indexes[i]];
+            }
+            rows.push_back(std::move(row));
+        }
+    }
+
+    static int64_t RowsBytes(const std::vector<std::vector<uint>>& rows) {
+        if (rows.empty())
+            return 0;
+        return rows.size() * (sizeof(std::vector<uint>) + rows[0].size() * sizeof(uint));
+    }
+
+    void Merge(std::vector<std::vector<std::vector<uint>>>& branch_results, size_t project_cnt) {
+        bool distinct =
+            _p_parser->project_modifier().modifier_type_ == SPARQLParser::ProjectModifier::Distinct;
+        size_t limit = _p_parser->Limit();
+        size_t offset = _p_parser->Offset();
+        size_t wanted = limit == UINTMAX_MAX ? limit : offset + limit;
+
+        std::set<std::vector<uint>> seen;
+        for (auto& rows : branch_results) {
+            for (auto& row : rows) {
+                if (_order_by.empty() && _result.size() >= wanted)
+                    break;
+                if (distinct && !seen.emplace(row.begin(), row.begin() + project_cnt).second)
+                    continue;
+                _result.push_back(std::move(row));
+            }
+        }
+
+        if (!_order_by.empty()) {
+            _order_by.Sort(_result, offset, false);
+            if (_guard)
+                _guard->AddMemory(_order_by.memory());
+        } else {
+            _result.erase(_result.begin(), _result.begin() + std::min(offset, _result.size()));
+        }
+        if (_result.size() > limit)
+            _result.resize(limit);
+
+        for (auto& row : _result) {
+            row.resize(project_cnt);
+        }
+    }
+
+   private:
+    std::shared_ptr<IndexRetriever> _p_index;
+    std::shared_ptr<SPARQLParser> _p_parser;
+
+    std::vector<std::vector<uint>> _result;
+    std::vector<Pos> _variable_positions;
+    OrderBy _order_by;
+    std::shared_ptr<QueryGuard> _guard;
+    std::shared_ptr<PlanCache> _plan_cache;
+    std::shared_ptr<BS::thread_pool> _thread_pool;
+
+    std::chrono::system_clock::time_point _query_begin_time, _query_end_time;
+};
+
+#endif  // UNION_EXECUTOR_HPP
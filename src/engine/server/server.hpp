@@ -2,24 +2,62 @@
 #define SERVER_HPP
 
 #include <httplib.h>
+#include <signal.h>
+#include <algorithm>
+#include <atomic>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <nlohmann/json.hpp>
 #include <set>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <unordered_set>
 #include <utility>
 
 #include "../parser/sparql_parser.hpp"
+#include "../query/aggregate_executor.hpp"
 #include "../query/query_executor.hpp"
+#include "../query/plan_cache.hpp"
+#include "../query/query_guard.hpp"
 #include "../query/query_plan.hpp"
 #include "../query/query_result.hpp"
+#include "../query/result_cache.hpp"
+#include "../query/union_executor.hpp"
 #include "../store/index.hpp"
 #include "../store/index_builder.hpp"
 
-std::string db_name;
-std::shared_ptr<IndexRetriever> db_index;
+// 当前打开的数据库。每个请求开始时取一次快照，之后只使用快照中的索引、名字和版本，
+// 切换数据库时整体替换，不会看到一半新一半旧的状态
+struct DbState {
+    std::string name_;
+    std::shared_ptr<IndexRetriever> index_;
+    // 数据库每次切换、关闭或删除后加一，是结果缓存的键的一部分
+    uint version_ = 0;
+};
+std::shared_ptr<const DbState> db_state = std::make_shared<DbState>();
+// 串行化数据库的切换、关闭和删除
+std::mutex db_mutex;
+// 切换数据库时也使用启动时指定的加载策略
+LoadPolicies load_policies;
+// 查询默认的最长执行时间（毫秒）和可以使用的内存（MB），0 表示不限制
+uint query_timeout = 0;
+uint query_memory_limit = 0;
+// 所有查询共享的计划缓存，切换或关闭数据库时清空
+std::shared_ptr<PlanCache> plan_cache = std::make_shared<PlanCache>();
+// 所有查询共享的线程池，执行 UNION 的分支和聚合
+std::shared_ptr<BS::thread_pool> thread_pool = std::make_shared<BS::thread_pool>();
+// 查询结果的缓存，键包含数据库的名字和版本
+std::shared_ptr<ResultCache> result_cache = std::make_shared<ResultCache>(0);
+// 预编译的查询 statement_id -> (规范化的查询文本, 解析结果)，超过 max_statements 时删除最早的
+std::mutex statements_mutex;
+std::map<uint, std::pair<std::string, std::shared_ptr<SPARQLParser>>> statements;
+uint next_statement_id = 1;
+const size_t max_statements = 4096;
 
 std::vector<std::string> list_db() {
     std::vector<std::string> rdf_db_list;
@@ -39,45 +77,175 @@ std::vector<std::string> list_db() {
     return rdf_db_list;
 }
 
-void execute_query(std::string& sparql, nlohmann::json& res) {
-    if (db_index == 0) {
-        std::cout << "database doesn't be loaded correctly." << std::endl;
+// 解码后的字符串结果占用的内存（字节）
+size_t results_bytes(const std::vector<std::vector<std::string>>& results_str) {
+    size_t bytes = 0;
+    for (const auto& row : results_str) {
+        bytes += sizeof(row) + row.size() * sizeof(std::string);
+        for (const auto& str : row) {
+            bytes += str.capacity() > sizeof(std::string) ? str.capacity() : 0;
+        }
     }
+    return bytes;
+}
 
-    auto start = std::chrono::high_resolution_clock::now();
+std::shared_ptr<const DbState> current_db() {
+    return std::atomic_load(&db_state);
+}
 
-    auto parser = std::make_shared<SPARQLParser>(sparql);
-    auto query_plan = std::make_shared<QueryPlan>(db_index, parser->TripleList(), parser->Limit());
+// 打开的索引在最后一个使用它的请求结束后才关闭，切换数据库时正在执行的查询仍然可以读旧的索引
+std::shared_ptr<IndexRetriever> open_index(const std::string& name) {
+    return std::shared_ptr<IndexRetriever>(new IndexRetriever(name, load_policies), [](IndexRetriever* index) {
+        index->close();
+        delete index;
+    });
+}
 
-    auto executor = std::make_shared<QueryExecutor>(db_index, query_plan);
-    executor->Query();
+// 先换上新的数据库，再清空缓存：之后开始的请求只会看到新的数据库。
+// 切换时还在执行的查询写入的结果使用旧的版本作为键，不会被新的请求读到；
+// 它们写入计划缓存的计划属于旧的索引，PlanCache 不会把它们用于新的索引
+void switch_db(const std::string& name, const std::shared_ptr<IndexRetriever>& index) {
+    auto state = std::make_shared<DbState>();
+    state->name_ = name;
+    state->index_ = index;
+    state->version_ = current_db()->version_ + 1;
+    std::atomic_store(&db_state, std::shared_ptr<const DbState>(std::move(state)));
+    plan_cache->Clear();
+    result_cache->Clear();
+}
 
-    std::vector<std::string> variables = parser->ProjectVariables();
-    const auto variable_indexes = query_plan->MappingVariable(variables);
+// 执行查询，结果按照投影变量的顺序保存为 id（聚合查询是字符串）
+std::shared_ptr<ResultCache::Entry> run_query(const std::shared_ptr<IndexRetriever>& db_index,
+                                              const std::shared_ptr<SPARQLParser>& parser,
+                                              const std::shared_ptr<QueryGuard>& guard) {
+    auto entry = std::make_shared<ResultCache::Entry>();
+    if (parser->HasAggregate()) {
+        auto executor = std::make_shared<AggregateExecutor>(db_index, parser);
+        executor->SetGuard(guard);
+        executor->SetPlanCache(plan_cache);
+        executor->SetThreadPool(thread_pool);
+        executor->Query();
+        entry->strings_ = std::move(executor->query_result());
+    } else if (parser->HasUnion()) {
+        auto executor = std::make_shared<UnionExecutor>(db_index, parser);
+        executor->SetGuard(guard);
+        executor->SetPlanCache(plan_cache);
+        executor->SetThreadPool(thread_pool);
+        executor->Query();
+        entry->rows_ = std::move(executor->query_result());
+        const auto& positions = executor->variable_positions();
+        for (uint i = 0; i < positions.size(); i++) {
+            entry->columns_.emplace_back(i, positions[i]);
+        }
+    } else {
+        auto query_plan =
+            plan_cache->Get(db_index, parser->TripleList(), parser->Limit(), parser->Offset(), parser->OrderBy());
+
+        auto executor = std::make_shared<QueryExecutor>(db_index, query_plan);
+        executor->SetGuard(guard);
+        executor->Query();
 
+        entry->rows_ = std::move(executor->query_result());
+        entry->columns_ = query_plan->MappingVariable(parser->ProjectVariables());
+        if (parser->project_modifier().modifier_type_ == SPARQLParser::ProjectModifier::Distinct)
+            distinct_rows(entry->rows_, entry->columns_);
+    }
+    return entry;
+}
+
+// 在 db 上执行查询。cache_key 为空时不使用结果缓存，connection_closed 返回 true 时（客户端已经断开）取消查询
+void execute_query(const std::shared_ptr<const DbState>& db,
+                   const std::shared_ptr<SPARQLParser>& parser,
+                   nlohmann::json& res,
+                   uint timeout,
+                   std::chrono::high_resolution_clock::time_point start,
+                   const std::string& cache_key,
+                   const std::function<bool()>& connection_closed) {
+    const auto& db_index = db->index_;
+
+    auto guard = std::make_shared<QueryGuard>(timeout, size_t(query_memory_limit) << 20);
+    guard->SetCancelCheck(connection_closed);
+
+    std::vector<std::string> variables = parser->ProjectVariables();
     res["head"]["vars"] = variables;
-    std::vector<std::vector<uint>>& results_id = executor->query_result();
 
-    std::chrono::duration<double, std::milli> diff;
-    std::chrono::high_resolution_clock::time_point finish;
+    std::string key;
+    std::shared_ptr<const ResultCache::Entry> entry;
+    if (!cache_key.empty() && result_cache->capacity() > 0) {
+        key = db->name_ + "@" + std::to_string(db->version_) + "\n" + cache_key;
+        entry = result_cache->Get(key);
+    }
+    bool cached = entry != nullptr;
+    if (!cached) {
+        auto result = run_query(db_index, parser, guard);
+        // 超时和取消的结果不完整，超过内存上限的结果会被丢弃，都不缓存
+        if (!key.empty() && !guard->Stopped())
+            result_cache->Put(key, result);
+        entry = result;
+    }
 
     uint cnt = 0;
-    if (results_id.size() == 0) {
-        finish = std::chrono::high_resolution_clock::now();
-        res["results"]["bindings"] = std::vector<uint>();
-    } else {
-        std::vector<std::vector<std::string>> results_str(results_id.size(),
-                                                          std::vector<std::string>(variables.size()));
-        cnt = query_result(results_id, results_str, db_index, variable_indexes, parser);
-        finish = std::chrono::high_resolution_clock::now();
-        res["results"]["bindings"] = results_str;
+    if (!guard->MemoryExceeded()) {
+        if (!entry->strings_.empty()) {
+            guard->AddMemory(results_bytes(entry->strings_));
+            if (!guard->MemoryExceeded()) {
+                res["results"]["bindings"] = entry->strings_;
+                cnt = entry->strings_.size();
+            }
+        } else if (!entry->rows_.empty()) {
+            std::vector<std::vector<std::string>> results_str(entry->rows_.size(),
+                                                              std::vector<std::string>(variables.size()));
+            std::string scratch;
+            for (size_t r = 0; r < entry->rows_.size(); r++) {
+                const auto& row = entry->rows_[r];
+                for (size_t i = 0; i < entry->columns_.size(); i++) {
+                    uint id = row[entry->columns_[i].first];
+                    if (id != 0)
+                        results_str[r][i] = db_index->ID2String(id, entry->columns_[i].second, scratch);
+                }
+            }
+            guard->AddMemory(results_bytes(results_str));
+            if (!guard->MemoryExceeded()) {
+                res["results"]["bindings"] = std::move(results_str);
+                cnt = entry->rows_.size();
+            }
+        }
     }
-    diff = finish - start;
+    if (cnt == 0)
+        res["results"]["bindings"] = std::vector<uint>();
+
+    std::chrono::duration<double, std::milli> diff = std::chrono::high_resolution_clock::now() - start;
 
     res["results"]["binding_cnt"] = res["results"]["bindings"].size();
     res["results"]["time_cost"] = diff.count();
+    res["results"]["cached"] = cached;
+    // 超时的查询返回部分结果，超过内存上限的查询不返回结果
+    res["results"]["timed_out"] = guard->TimedOut();
+    res["results"]["cancelled"] = guard->Cancelled();
+    res["results"]["peak_memory"] = guard->PeakMemory();
+    if (guard->MemoryExceeded()) {
+        res["results"]["error"] = "Query exceeds the memory limit of " + std::to_string(query_memory_limit) + " MB";
+        cnt = 0;
+    }
 
-    std::cout << cnt << " result(s)" << std::endl;
+    std::cout << cnt << " result(s)" << (cached ? " from the result cache" : "")
+              << (guard->Cancelled() ? ", cancelled because the client disconnected" : "") << ", peak memory "
+              << guard->PeakMemory() / 1024.0 << " KB" << std::endl;
+}
+
+void execute_query(const std::shared_ptr<const DbState>& db,
+                   std::string& sparql,
+                   nlohmann::json& res,
+                   uint timeout,
+                   const std::function<bool()>& connection_closed) {
+    auto start = std::chrono::high_resolution_clock::now();
+    auto parser = std::make_shared<SPARQLParser>(sparql);
+    if (!parser->Parameters().empty()) {
+        res["code"] = 11;
+        res["message"] = "The query has parameters, prepare it with /prepare and execute it with /execute";
+        return;
+    }
+    execute_query(db, parser, res, timeout, start, ResultCache::Normalize(sparql), connection_closed);
 }
 
 void list(const httplib::Request& req, httplib::Response& res) {
@@ -91,11 +259,21 @@ void info(const httplib::Request& req, httplib::Response& res) {
     std::cout << "Catch info request from http://" << req.remote_addr << ":" << req.remote_port << std::endl;
     std::unordered_map<std::string, uint32_t> data;
 
-    if (db_index) {
+    auto db = current_db();
+    if (const auto& db_index = db->index_) {
         data["triplets"] = db_index->triplet_cnt();
         data["predicates"] = db_index->predicate_cnt();
         data["entities"] = db_index->entity_cnt();
+        data["posting_cache_hits"] = db_index->posting_cache().hits();
+        data["posting_cache_misses"] = db_index->posting_cache().misses();
     }
+    data["plan_cache_size"] = plan_cache->size();
+    data["plan_cache_hits"] = plan_cache->hits();
+    data["plan_cache_misses"] = plan_cache->misses();
+    data["result_cache_size"] = result_cache->size();
+    data["result_cache_bytes"] = result_cache->bytes();
+    data["result_cache_hits"] = result_cache->hits();
+    data["result_cache_misses"] = result_cache->misses();
 
     nlohmann::json j;
     j["data"] = data;
@@ -105,11 +283,123 @@ void info(const httplib::Request& req, httplib::Response& res) {
 void query(const httplib::Request& req, httplib::Response& res) {
     std::cout << "Catch query request from http://" << req.remote_addr << ":" << req.remote_port << std::endl;
 
+    auto db = current_db();
     std::string sparql = req.get_param_value("query");
-    std::cout << db_name << " " << req.get_param_value("query") << std::endl;
+    std::cout << db->name_ << " " << req.get_param_value("query") << std::endl;
+    nlohmann::json response;
+
+    uint timeout = query_timeout;
+    if (req.has_param("timeout")) {
+        std::string value = req.get_param_value("timeout");
+        if (value.empty() || value.size() > 9 || !std::all_of(value.begin(), value.end(), ::isdigit)) {
+            response["code"] = 7;
+            response["message"] = "The timeout parameter requires a number of milliseconds";
+            res.set_content(response.dump(2), "text/plain;charset=utf-8");
+            return;
+        }
+        timeout = std::stoul(value);
+    }
+
+    if (db->index_)
+        execute_query(db, sparql, response, timeout, req.is_connection_closed);
+
+    res.set_content(response.dump(2), "application/sparql-results+json;charset=utf-8");
+}
+
+// body: {"query": "SELECT ?x WHERE { ?x <knows> $person . }"}
+void prepare(const httplib::Request& req, httplib::Response& res) {
+    std::cout << "Catch prepare request from http://" << req.remote_addr << ":" << req.remote_port
+              << std::endl;
+
+    nlohmann::json body = nlohmann::json::parse(req.body);
+    nlohmann::json response;
+    if (!body.contains("query") || !body["query"].is_string()) {
+        response["code"] = 8;
+        response["message"] = "Didn't specify a query";
+        res.set_content(response.dump(2), "text/plain;charset=utf-8");
+        return;
+    }
+
+    std::string sparql = body["query"].get<std::string>();
+    std::shared_ptr<SPARQLParser> parser;
+    try {
+        parser = std::make_shared<SPARQLParser>(sparql);
+    } catch (const SPARQLParser::ParserException& e) {
+        response["code"] = 9;
+        response["message"] = e.to_string();
+        res.set_content(response.dump(2), "text/plain;charset=utf-8");
+        return;
+    }
+
+    uint statement_id;
+    {
+        std::lock_guard<std::mutex> lock(statements_mutex);
+        statement_id = next_statement_id++;
+        statements[statement_id] = {ResultCache::Normalize(sparql), parser};
+        if (statements.size() > max_statements)
+            statements.erase(statements.begin());
+    }
+
+    response["code"] = 1;
+    response["statement_id"] = statement_id;
+    response["parameters"] = parser->Parameters();
+    res.set_content(response.dump(2), "text/plain;charset=utf-8");
+}
+
+// body: {"statement_id": 1, "parameters": ["<alice>"], "timeout": 1000}，timeout 可以省略
+void execute(const httplib::Request& req, httplib::Response& res) {
+    std::cout << "Catch execute request from http://" << req.remote_addr << ":" << req.remote_port
+              << std::endl;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    nlohmann::json body = nlohmann::json::parse(req.body);
     nlohmann::json response;
-    if (db_name != "")
-        execute_query(sparql, response);
+
+    std::string cache_key;
+    std::shared_ptr<SPARQLParser> parser;
+    if (body.contains("statement_id") && body["statement_id"].is_number_unsigned()) {
+        std::lock_guard<std::mutex> lock(statements_mutex);
+        auto it = statements.find(body["statement_id"].get<uint>());
+        if (it != statements.end())
+            std::tie(cache_key, parser) = it->second;
+    }
+    if (!parser) {
+        response["code"] = 10;
+        response["message"] = "Unknown statement_id";
+        res.set_content(response.dump(2), "text/plain;charset=utf-8");
+        return;
+    }
+
+    uint timeout = query_timeout;
+    if (body.contains("timeout")) {
+        if (!body["timeout"].is_number_unsigned()) {
+            response["code"] = 7;
+            response["message"] = "The timeout parameter requires a number of milliseconds";
+            res.set_content(response.dump(2), "text/plain;charset=utf-8");
+            return;
+        }
+        timeout = body["timeout"].get<uint>();
+    }
+
+    try {
+        std::vector<std::string> parameters;
+        if (body.contains("parameters"))
+            parameters = body["parameters"].get<std::vector<std::string>>();
+        parser = std::make_shared<SPARQLParser>(*parser);
+        parser->Bind(parameters);
+        for (const auto& value : parameters) {
+            cache_key += '\x1f' + value;
+        }
+    } catch (const std::exception& e) {
+        response["code"] = 11;
+        response["message"] = e.what();
+        res.set_content(response.dump(2), "text/plain;charset=utf-8");
+        return;
+    }
+
+    auto db = current_db();
+    if (db->index_)
+        execute_query(db, parser, response, timeout, start, cache_key, req.is_connection_closed);
 
     res.set_content(response.dump(2), "application/sparql-results+json;charset=utf-8");
 }
@@ -165,7 +455,8 @@ void load_db(const httplib::Request& req, httplib::Response& res) {
 
     std::string new_db_name = body["db_name"];
 
-    if (new_db_name == db_name) {
+    std::lock_guard<std::mutex> lock(db_mutex);
+    if (new_db_name == current_db()->name_) {
         response["code"] = 3;
         response["message"] = "Same RDF, no need to switch";
         res.status = 200;
@@ -173,24 +464,20 @@ void load_db(const httplib::Request& req, httplib::Response& res) {
         return;
     }
 
-    if (db_name != "")
-        db_index->close();
-
-    db_index = std::make_shared<IndexRetriever>(new_db_name);
-    db_name = new_db_name;
+    switch_db(new_db_name, open_index(new_db_name));
 
     response["code"] = 1;
-    response["message"] = "RDF have been switched to " + db_name;
-    std::cout << "RDF have been switched into <" << db_name << ">." << std::endl;
+    response["message"] = "RDF have been switched to " + new_db_name;
+    std::cout << "RDF have been switched into <" << new_db_name << ">." << std::endl;
     res.status = 200;
     res.set_content(response.dump(2), "text/plain;charset=utf-8");
 }
 
 void close_db(const httplib::Request& req, httplib::Response& res) {
     std::cout << "Catch close request from http://" << req.remote_addr << ":" << req.remote_port << std::endl;
-    if (db_name != "") {
-        db_index->close();
-        db_name = "";
+    {
+        std::lock_guard<std::mutex> lock(db_mutex);
+        switch_db("", nullptr);
     }
 
     nlohmann::json response;
@@ -219,10 +506,8 @@ void delete_db(const httplib::Request& req, httplib::Response& res) {
 
     std::string delete_db_name = body["db_name"];
 
-    if (delete_db_name == db_name && db_name != "") {
-        db_index->close();
-    }
-    db_name = "";
+    std::lock_guard<std::mutex> lock(db_mutex);
+    switch_db("", nullptr);
 
     try {
         std::string path = "./DB_DATA_ARCHIVE/" + delete_db_name;
@@ -236,7 +521,7 @@ void delete_db(const httplib::Request& req, httplib::Response& res) {
     }
 
     response["code"] = 1;
-    response["message"] = db_name + " RDF have been deleted";
+    response["message"] = delete_db_name + " RDF have been deleted";
     std::cout << "RDF have been deleted" << std::endl;
     res.status = 200;
     res.set_content(response.dump(2), "text/plain;charset=utf-8");
@@ -269,10 +554,51 @@ void upload(const httplib::Request& req, httplib::Response& res) {
     res.set_content(j.dump(2), "text/plain;charset=utf-8");
 }
 
-bool start_server(const std::string& ip, const std::string& port, const std::string& db) {
+// 收到 SIGTERM 或 SIGINT 时停止服务器，让 start_server 在返回之前关闭数据库（并记录访问过的索引页面）。
+// 这两个信号在所有线程中被屏蔽，由 watcher 线程用 sigtimedwait 等待，所以可以安全地调用 svr.stop()。
+// done 为 true 时 watcher 线程退出
+std::thread watch_signals(httplib::Server& svr, const std::atomic<bool>& done) {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    // 之后创建的线程继承这个屏蔽字
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    return std::thread([&svr, &done, signals]() {
+        timespec timeout = {0, 200 * 1000 * 1000};
+        while (!done.load()) {
+            int signal = sigtimedwait(&signals, nullptr, &timeout);
+            if (signal == SIGTERM || signal == SIGINT) {
+                std::cout << "received signal " << signal << ", stopping the server." << std::endl;
+                // 信号可能在加载数据库时到达，等到服务器开始监听后再停止
+                while (!done.load() && !svr.is_running())
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                svr.stop();
+                return;
+            }
+        }
+    });
+}
+
+bool start_server(const std::string& ip,
+                  const std::string& port,
+                  const std::string& db,
+                  uint timeout,
+                  uint memory_limit,
+                  uint result_cache_size,
+                  uint sampling_budget,
+                  const LoadPolicies& policies) {
     std::cout << "Running at:" + ip + ":" << port << std::endl;
 
     httplib::Server svr;
+    std::atomic<bool> stopped = false;
+    std::thread watcher = watch_signals(svr, stopped);
+
+    load_policies = policies;
+    query_timeout = timeout;
+    query_memory_limit = memory_limit;
+    result_cache = std::make_shared<ResultCache>(size_t(result_cache_size) << 20);
+    plan_cache->SetSamplingBudget(sampling_budget);
 
     svr.set_default_headers({{"Access-Control-Allow-Origin", "*"},
                              {"Access-Control-Allow-Methods", "POST, GET, PUT, OPTIONS, DELETE"},
@@ -299,13 +625,18 @@ bool start_server(const std::string& ip, const std::string& port, const std::str
         svr.Options(base_url + "/delete",
                     [](const httplib::Request& req, httplib::Response& res) { res.status = 200; });
     } else {
-        db_index = std::make_shared<IndexRetriever>(db);
-        db_name = db;
+        switch_db(db, open_index(db));
     }
 
     svr.Get(base_url + "/sparql", query);  // query on RDF
     svr.Options(base_url + "/sparql",
                 [](const httplib::Request& req, httplib::Response& res) { res.status = 200; });
+    svr.Post(base_url + "/prepare", prepare);  // prepare a parameterized query
+    svr.Post(base_url + "/execute", execute);  // execute a prepared query with parameters
+    svr.Options(base_url + "/prepare",
+                [](const httplib::Request& req, httplib::Response& res) { res.status = 200; });
+    svr.Options(base_url + "/execute",
+                [](const httplib::Request& req, httplib::Response& res) { res.status = 200; });
 
     // disconnect
     svr.Get(base_url + "/disconnect", [&](const httplib::Request& req, httplib::Response& res) {
@@ -317,6 +648,11 @@ bool start_server(const std::string& ip, const std::string& port, const std::str
         res.set_content(j.dump(2), "text/plain;charset=utf-8");
     });
     svr.listen(ip, std::stoi(port));
+    stopped = true;
+    watcher.join();
+
+    // 关闭时（/disconnect、SIGTERM 或 SIGINT）记录访问过的索引页面，见 AccessTrace
+    switch_db("", nullptr);
     return 0;
 }
 
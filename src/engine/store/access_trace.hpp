@@ -0,0 +1,139 @@
+#ifndef ACCESS_TRACE_HPP
+#define ACCESS_TRACE_HPP
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// 索引文件的访问记录：关闭数据库时用 mincore 记录每个映射的文件有哪些页面在页缓存中，
+// 下次打开时并行预读这些页面，重启后服务在接受请求之前就是热的。记录在关闭时进行，查询路径上没有额外的开销，
+// 代价是记录的是页缓存中的页面，也包括内核预读进来但查询没有访问的页面。
+// 文件按 uint 保存：文件个数，然后每个文件依次是文件编号、页面区间个数 k、k 个 (起始页, 页数)
+class AccessTrace {
+   public:
+    struct File {
+        uint id_;  // 在 LoadPolicies::kFiles 中的位置
+        void* map_;
+        size_t size_;  // bytes
+    };
+
+    // 写入临时文件后再改名，写入中途退出不会留下不完整的记录
+    static bool Record(const std::string& path, const std::vector<File>& files) {
+        size_t page = PageSize();
+        std::vector<uint> words = {uint(files.size())};
+        std::vector<unsigned char> resident;
+        for (const auto& file : files) {
+            words.push_back(file.id_);
+            size_t count_pos = words.size();
+            words.push_back(0);
+            if (file.map_ == nullptr || file.size_ == 0)
+                continue;
+
+            size_t pages = (file.size_ + page - 1) / page;
+            resident.assign(pages, 0);
+            if (mincore(file.map_, file.size_, resident.data()) == -1)
+                continue;
+            for (size_t i = 0; i < pages;) {
+                if (!(resident[i] & 1)) {
+                    i++;
+                    continue;
+                }
+                size_t begin = i;
+                while (i < pages && (resident[i] & 1))
+                    i++;
+                words.push_back(begin);
+                words.push_back(i - begin);
+                words[count_pos]++;
+            }
+        }
+
+        std::string tmp = path + ".tmp";
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out.write(reinterpret_cast<const char*>(words.data()), words.size() * sizeof(uint))) {
+            std::remove(tmp.c_str());
+            return false;
+        }
+        out.close();
+        return std::rename(tmp.c_str(), path.c_str()) == 0;
+    }
+
+    // 先对所有区间 madvise(MADV_WILLNEED) 提交读请求，再用 threads 个线程逐页读取，等待读入完成。
+    // 没有记录或者记录损坏时不预读，返回预读的字节数
+    static size_t Replay(const std::string& path, const std::vector<File>& files, uint threads) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open())
+            return 0;
+        std::vector<uint> words;
+        uint word;
+        while (in.read(reinterpret_cast<char*>(&word), sizeof(uint))) {
+            words.push_back(word);
+        }
+
+        size_t page = PageSize();
+        // (起始地址, 字节数)
+        std::vector<std::pair<char*, size_t>> ranges;
+        size_t offset = 0;
+        uint file_cnt = words.empty() ? 0 : words[offset++];
+        for (uint f = 0; f < file_cnt; f++) {
+            if (offset + 2 > words.size())
+                break;
+            uint id = words[offset++];
+            uint range_cnt = words[offset++];
+            if (offset + 2 * size_t(range_cnt) > words.size())
+                break;
+            const File* file = nullptr;
+            for (const auto& candidate : files) {
+                if (candidate.id_ == id && candidate.map_ != nullptr)
+                    file = &candidate;
+            }
+            for (uint r = 0; r < range_cnt; r++, offset += 2) {
+                size_t begin = size_t(words[offset]) * page;
+                size_t end = std::min(file ? file->size_ : 0, begin + size_t(words[offset + 1]) * page);
+                if (file && begin < end)
+                    ranges.emplace_back(static_cast<char*>(file->map_) + begin, end - begin);
+            }
+        }
+
+        size_t bytes = 0;
+        for (const auto& [begin, size] : ranges) {
+            madvise(begin, size, MADV_WILLNEED);
+            bytes += size;
+        }
+
+        // 按字节数把区间分给各个线程
+        threads = std::max<uint>(1, threads);
+        size_t share = bytes / threads + 1;
+        std::vector<std::thread> workers;
+        size_t next = 0;
+        for (uint t = 0; t < threads && next < ranges.size(); t++) {
+            size_t first = next;
+            size_t assigned = 0;
+            while (next < ranges.size() && assigned < share) {
+                assigned += ranges[next++].second;
+            }
+            workers.emplace_back([&ranges, first, last = next, page]() {
+                volatile char sink = 0;
+                for (size_t i = first; i < last; i++) {
+                    for (size_t pos = 0; pos < ranges[i].second; pos += page) {
+                        sink = sink + ranges[i].first[pos];
+                    }
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        return bytes;
+    }
+
+   private:
+    static size_t PageSize() { return sysconf(_SC_PAGESIZE); }
+};
+
+#endif  // ACCESS_TRACE_HPP
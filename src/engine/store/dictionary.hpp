@@ -7,13 +7,16 @@
 #include <future>
 #include <iostream>
 #include <list>
+#include <memory>
+#include <numeric>
+#include <string_view>
+#include "./front_coding.hpp"
 #include "./mmap.hpp"
 
 template <typename Key, typename Value>
 using hash_map = phmap::flat_hash_map<Key, Value>;
 
 enum Pos { kSubject, kPredicate, kObject, kShared };
-enum Map { kSubjectMap, kPredicateMap, kObjectMap, kSharedMap };
 
 class Dictionary {
     std::string dict_path_;
@@ -34,15 +37,34 @@ class Dictionary {
     // phmap::flat_hash_set<std::string> subject_set_;
     // phmap::flat_hash_set<std::string> object_set_;
 
-    std::array<hash_map<std::string, uint>, 6> subject2id_;
+    // 加载后主语、宾语和共享实体放在同一组哈希表中，值是全局 id。字符串按哈希值分到 kPartitions 个表，
+    // 查找只访问一个表；按位置查找时再用 id 的区间判断实体是否可以出现在这个位置
+    // 键指向 arenas_ 中的字符串，不单独保存
+    static constexpr uint kPartitions = 6;
+    std::array<hash_map<std::string_view, uint>, kPartitions> entity2id_;
     hash_map<std::string, uint> predicate2id_;
-    std::array<hash_map<std::string, uint>, 6> object2id_;
-    std::array<hash_map<std::string, uint>, 6> shared2id_;
-
-    std::vector<std::string> id2subject_;
+    // 加载时每个字典文件中的实体按分区分组的全局 id，[pos][文件][分区]
+    std::vector<uint> routed_ids_[3][6][kPartitions];
+
+    // 每个字典文件整体读入一块连续的内存，去掉最后的换行，字符串之间用换行分隔，[pos][文件]。
+    // pos 的顺序是主语、宾语、共享实体
+    std::string arenas_[3][6];
+    // 实体的字符串在所在文件的内存块中的起始位置，id 对 6 取模就是文件的编号，
+    // 同一个文件中的下一个实体是 id + 6，字符串到它的起始位置之前的换行为止
+    std::vector<uint64_t> id2subject_;
     std::vector<std::string> id2predicate_;
-    std::vector<std::string> id2object_;
-    std::vector<std::string> id2shared_;
+    std::vector<uint64_t> id2object_;
+    std::vector<uint64_t> id2shared_;
+
+    // 压缩模式只保存前缀压缩后的实体，不建立哈希表，[pos]
+    bool compressed_ = false;
+    std::shared_ptr<Namespaces> namespaces_;
+    FrontCodedStrings compressed_terms_[3];
+    // 新版本构建的数据库每组实体的 id 按字典序分配，压缩后的位置就是 id - 1；
+    // 旧版本构建的数据库需要保存 id 和排序后的位置之间的映射
+    bool sorted_ids_ = false;
+    std::vector<uint> id2rank_[3];
+    std::vector<uint> rank2id_[3];
 
     void InitSerialize() {
         std::filesystem::path subjects_path = dict_path_ + "/subjects";
@@ -64,17 +86,17 @@ class Dictionary {
         //     shared2id_[i] = hash_map<std::string, uint>();
         // }
 
-        id2subject_ = std::vector<std::string>();
+        id2subject_ = std::vector<uint64_t>();
         id2predicate_ = std::vector<std::string>();
-        id2object_ = std::vector<std::string>();
-        id2shared_ = std::vector<std::string>();
+        id2object_ = std::vector<uint64_t>();
+        id2shared_ = std::vector<uint64_t>();
 
         std::string cnt;
         std::ifstream db_info(dict_path_ + "/dict_info", std::ofstream::out | std::ofstream::binary);
 
         std::getline(db_info, cnt);
         subject_cnt_ = std::stoi(cnt);
-        id2subject_ = std::vector<std::string>(subject_cnt_ + 1);
+        id2subject_ = std::vector<uint64_t>(subject_cnt_ + 1);
 
         std::getline(db_info, cnt);
         predicate_cnt_ = std::stoi(cnt);
@@ -82,15 +104,18 @@ class Dictionary {
 
         std::getline(db_info, cnt);
         object_cnt_ = std::stoi(cnt);
-        id2object_ = std::vector<std::string>(object_cnt_ + 1);
+        id2object_ = std::vector<uint64_t>(object_cnt_ + 1);
 
         std::getline(db_info, cnt);
         shared_cnt_ = std::stoi(cnt);
-        id2shared_ = std::vector<std::string>(shared_cnt_ + 1);
+        id2shared_ = std::vector<uint64_t>(shared_cnt_ + 1);
 
         std::getline(db_info, cnt);
         triplet_cnt_ = std::stoi(cnt);
 
+        // 旧版本构建的数据库没有这一行
+        sorted_ids_ = std::getline(db_info, cnt) && cnt == "sorted";
+
         db_info.close();
     }
 
@@ -201,28 +226,39 @@ class Dictionary {
         hash_map<uint, uint> object_reasign_id;
         hash_map<uint, uint> shared_reasign_id;
 
+        // 每组实体的 id 按字典序分配，加载压缩的字典时不需要重新排序
+        auto sorted = [](hash_map<std::string, uint>& map) {
+            std::vector<std::pair<const std::string, uint>*> entries;
+            entries.reserve(map.size());
+            for (auto& entry : map) {
+                entries.push_back(&entry);
+            }
+            std::sort(entries.begin(), entries.end(), [](auto* a, auto* b) { return a->first < b->first; });
+            return entries;
+        };
+
         uint subject_id = 1;
         uint object_id = 1;
         uint shared_id = 1;
-        for (auto it = subjects_.begin(); it != subjects_.end(); it++) {
-            subject_reasign_id[it->second] = subject_id;
-            it->second = subject_id;
-            subject_outs[subject_id % 6].write((it->first + "\n").c_str(),
-                                               static_cast<long>(it->first.size() + 1));
+        for (auto* entry : sorted(subjects_)) {
+            subject_reasign_id[entry->second] = subject_id;
+            entry->second = subject_id;
+            subject_outs[subject_id % 6].write((entry->first + "\n").c_str(),
+                                               static_cast<long>(entry->first.size() + 1));
             subject_id++;
         }
-        for (auto it = objects_.begin(); it != objects_.end(); it++) {
-            object_reasign_id[it->second] = object_id;
-            it->second = object_id;
-            object_outs[object_id % 6].write((it->first + "\n").c_str(),
-                                             static_cast<long>(it->first.size() + 1));
+        for (auto* entry : sorted(objects_)) {
+            object_reasign_id[entry->second] = object_id;
+            entry->second = object_id;
+            object_outs[object_id % 6].write((entry->first + "\n").c_str(),
+                                             static_cast<long>(entry->first.size() + 1));
             object_id++;
         }
-        for (auto it = shared_.begin(); it != shared_.end(); it++) {
-            shared_reasign_id[it->second] = shared_id;
-            it->second = shared_id;
-            shared_outs[shared_id % 6].write((it->first + "\n").c_str(),
-                                             static_cast<long>(it->first.size() + 1));
+        for (auto* entry : sorted(shared_)) {
+            shared_reasign_id[entry->second] = shared_id;
+            entry->second = shared_id;
+            shared_outs[shared_id % 6].write((entry->first + "\n").c_str(),
+                                             static_cast<long>(entry->first.size() + 1));
             shared_id++;
         }
 
@@ -274,38 +310,37 @@ class Dictionary {
         dict_info.write(cnt.c_str(), cnt.size());
         cnt = std::to_string(triplet_cnt_) + "\n";
         dict_info.write(cnt.c_str(), cnt.size());
+        cnt = "sorted\n";
+        dict_info.write(cnt.c_str(), cnt.size());
 
         dict_info.close();
     }
 
-    uint Find(Map map, const std::string& str) {
-        hash_map<std::string, uint>::iterator it;
-        if (map == Map::kPredicateMap) {
-            it = predicate2id_.find(str);
-            if (it != predicate2id_.end())
-                return it->second;
-            else
-                return 0;
-        }
+    // 和哈希表内部使用的哈希函数不同，同一个分区中的字符串在表中仍然是均匀分布的
+    static uint Partition(std::string_view str) { return std::hash<std::string_view>()(str) % kPartitions; }
 
-        for (uint part = 0; part < 6; part++) {
-            if (map == Map::kSubjectMap) {
-                it = subject2id_[part].find(str);
-                if (it != subject2id_[part].end())
-                    return it->second;
-            }
-            if (map == Map::kObjectMap) {
-                it = object2id_[part].find(str);
-                if (it != object2id_[part].end())
-                    return it->second;
-            }
-            if (map == Map::kSharedMap) {
-                it = shared2id_[part].find(str);
-                if (it != shared2id_[part].end())
-                    return it->second;
-            }
-        }
-        return 0;
+    // 实体的全局 id，找不到时返回 0
+    uint FindEntity(const std::string& str) {
+        const hash_map<std::string_view, uint>& map = entity2id_[Partition(str)];
+        auto it = map.find(std::string_view(str));
+        return it != map.end() ? it->second : 0;
+    }
+
+    // 第 group 组实体中排序后位置是 rank 的实体的局部 id
+    uint RankToID(uint group, uint rank) const { return sorted_ids_ ? rank + 1 : rank2id_[group][rank]; }
+
+    uint IDToRank(uint group, uint id) const { return sorted_ids_ ? id - 1 : id2rank_[group][id]; }
+
+    // 压缩模式下 pos 位置的实体的全局 id，先查找共享实体，找不到时返回 0
+    uint FindCompressed(const std::string& str, Pos pos) {
+        uint rank = compressed_terms_[2].Find(str);
+        if (rank != compressed_terms_[2].size())
+            return RankToID(2, rank);
+        uint group = pos == kSubject ? 0 : 1;
+        rank = compressed_terms_[group].Find(str);
+        if (rank == compressed_terms_[group].size())
+            return 0;
+        return (group == 0 ? shared_cnt_ : shared_cnt_ + subject_cnt_) + RankToID(group, rank);
     }
 
     int FindInMaps(hash_map<std::string, uint>& map, const std::string& str) {
@@ -352,79 +387,192 @@ class Dictionary {
         return 0;
     }
 
-    uint FindInMaps(uint cnt, Map map, const std::string& str) {
-        uint ret;
-        if (shared_cnt_ > cnt) {
-            ret = Find(kSharedMap, str);
-            if (ret)
-                return ret;
-            ret = Find(map, str);
-            if (ret)
-                return ret;
-        } else {
-            ret = Find(map, str);
-            if (ret)
-                return ret;
-            ret = Find(kSharedMap, str);
-            if (ret)
-                return ret;
-        }
-        return 0;
-    }
-
     uint String2IDAfterLoad(const std::string& str, Pos pos) {
+        uint id;
         switch (pos) {
             case kSubject:  // subject
-                return shared_cnt_ + FindInMaps(subject_cnt_, kSubjectMap, str);
+                id = compressed_ ? FindCompressed(str, kSubject) : FindEntity(str);
+                return id <= shared_cnt_ + subject_cnt_ ? id : 0;
             case kPredicate: {  // predicate
-                return Find(kPredicateMap, str);
+                auto it = predicate2id_.find(str);
+                return it != predicate2id_.end() ? it->second : 0;
             }
             case kObject:  // object
-                return shared_cnt_ + subject_cnt_ + FindInMaps(object_cnt_, kObjectMap, str);
+                id = compressed_ ? FindCompressed(str, kObject) : FindEntity(str);
+                return id <= shared_cnt_ || id > shared_cnt_ + subject_cnt_ ? id : 0;
             default:
                 break;
         }
         return 0;
     }
 
+    // 第 group 组实体中局部 id 是 id 的字符串
+    std::string_view Term(uint group, const std::vector<uint64_t>& offsets, uint id) const {
+        const std::string& arena = arenas_[group][id % 6];
+        uint64_t begin = offsets[id];
+        uint64_t end = id + 6 < offsets.size() ? offsets[id + 6] - 1 : arena.size();
+        return std::string_view(arena.data() + begin, end - begin);
+    }
+
+    // 压缩模式下解码到 scratch 中
+    std::string_view EntityString(uint group, const std::vector<uint64_t>& offsets, uint id, std::string& scratch) const {
+        if (!compressed_)
+            return Term(group, offsets, id);
+        compressed_terms_[group].Get(IDToRank(group, id), scratch);
+        return scratch;
+    }
+
+    // 读取一个字典文件，记录每个实体的全局 id 所在的分区，哈希表在所有文件读完后按分区并行建立
     bool SubLoadDict(Pos pos, int part) {
-        hash_map<std::string, uint>* map = nullptr;
-        std::vector<std::string>* vec = nullptr;
+        std::vector<uint64_t>* vec = nullptr;
         std::string path = dict_path_;
+        uint offset = 0;
+        uint group = 0;
 
         if (pos == Pos::kSubject) {
-            map = &subject2id_[part];
             vec = &id2subject_;
             path += "/subjects/";
+            offset = shared_cnt_;
         }
         if (pos == Pos::kObject) {
-            map = &object2id_[part];
             vec = &id2object_;
             path += "/objects/";
+            offset = shared_cnt_ + subject_cnt_;
+            group = 1;
         }
         if (pos == Pos::kShared) {
-            map = &shared2id_[part];
             vec = &id2shared_;
             path += "/shared/";
+            group = 2;
         }
         path += std::to_string(part);
 
-        std::ifstream file_in(path, std::ofstream::out | std::ofstream::binary);
+        std::ifstream file_in(path, std::ifstream::in | std::ifstream::binary | std::ifstream::ate);
+        std::string& arena = arenas_[group][part];
+        arena.resize(file_in.is_open() ? static_cast<size_t>(file_in.tellg()) : 0);
+        file_in.seekg(0);
+        file_in.read(arena.data(), arena.size());
+        file_in.close();
+        if (!arena.empty() && arena.back() == '\n')
+            arena.pop_back();
 
-        std::string entity;
         uint id = part;
         if (part == 0)
             id = 6;
-        while (std::getline(file_in, entity)) {
-            map->insert({entity, id});
-            vec->at(id) = entity;
-            id += 6;
+        for (size_t begin = 0; begin < arena.size(); id += 6) {
+            size_t end = arena.find('\n', begin);
+            if (end == std::string::npos)
+                end = arena.size();
+            if (!compressed_)
+                routed_ids_[group][part][Partition(std::string_view(arena.data() + begin, end - begin))]
+                    .push_back(offset + id);
+            vec->at(id) = begin;
+            begin = end + 1;
         }
-        file_in.close();
 
         return true;
     };
 
+    // 非压缩模式下实体的全局 id 对应的字符串
+    std::string_view EntityView(uint id) const {
+        if (id <= shared_cnt_)
+            return Term(2, id2shared_, id);
+        if (id <= shared_cnt_ + subject_cnt_)
+            return Term(0, id2subject_, id - shared_cnt_);
+        return Term(1, id2object_, id - shared_cnt_ - subject_cnt_);
+    }
+
+    // 建立一个分区的哈希表，只有这个任务写这个表
+    bool BuildPartition(uint partition) {
+        hash_map<std::string_view, uint>& map = entity2id_[partition];
+        size_t size = 0;
+        for (auto& group : routed_ids_) {
+            for (auto& part : group) {
+                size += part[partition].size();
+            }
+        }
+        map.reserve(size);
+        for (auto& group : routed_ids_) {
+            for (auto& part : group) {
+                for (uint id : part[partition]) {
+                    map.insert({EntityView(id), id});
+                }
+                std::vector<uint>().swap(part[partition]);
+            }
+        }
+        return true;
+    }
+
+    // 按字典序排列三组实体（id 不是按字典序分配时），统计块头的命名空间，然后并行压缩，
+    // 最后释放读入的字典文件
+    void Compress() {
+        const std::vector<uint64_t>* offsets[3] = {&id2subject_, &id2object_, &id2shared_};
+        std::vector<std::string_view> terms[3];
+        std::vector<std::future<void>> tasks;
+        for (uint group = 0; group < 3; group++) {
+            tasks.emplace_back(std::async(std::launch::async, [this, &offsets, &terms, group]() {
+                uint cnt = offsets[group]->size() - 1;
+                std::vector<std::string_view>& sorted = terms[group];
+                sorted.reserve(cnt);
+                for (uint id = 1; id <= cnt; id++) {
+                    sorted.push_back(Term(group, *offsets[group], id));
+                }
+                if (sorted_ids_)
+                    return;
+
+                std::vector<uint>& rank2id = rank2id_[group];
+                rank2id.resize(cnt);
+                std::iota(rank2id.begin(), rank2id.end(), 1);
+                std::sort(rank2id.begin(), rank2id.end(),
+                          [&sorted](uint a, uint b) { return sorted[a - 1] < sorted[b - 1]; });
+                id2rank_[group].resize(cnt + 1);
+                std::vector<std::string_view> by_rank(cnt);
+                for (uint rank = 0; rank < cnt; rank++) {
+                    id2rank_[group][rank2id[rank]] = rank;
+                    by_rank[rank] = sorted[rank2id[rank] - 1];
+                }
+                sorted.swap(by_rank);
+            }));
+        }
+        for (auto& task : tasks) {
+            task.get();
+        }
+
+        std::vector<std::string_view> headers;
+        for (const auto& sorted : terms) {
+            for (size_t i = 0; i < sorted.size(); i += FrontCodedStrings::kBlockSize) {
+                headers.push_back(sorted[i]);
+            }
+        }
+        namespaces_ = std::make_shared<Namespaces>();
+        namespaces_->Build(headers);
+
+        tasks.clear();
+        for (uint group = 0; group < 3; group++) {
+            tasks.emplace_back(std::async(std::launch::async, [this, &terms, group]() {
+                compressed_terms_[group] = FrontCodedStrings(terms[group], namespaces_.get());
+            }));
+        }
+        for (auto& task : tasks) {
+            task.get();
+        }
+
+        for (auto& group : arenas_) {
+            for (auto& arena : group) {
+                std::string().swap(arena);
+            }
+        }
+        std::vector<uint64_t>().swap(id2subject_);
+        std::vector<uint64_t>().swap(id2object_);
+        std::vector<uint64_t>().swap(id2shared_);
+
+        size_t bytes = namespaces_->bytes();
+        for (uint group = 0; group < 3; group++) {
+            bytes += compressed_terms_[group].bytes() + (id2rank_[group].capacity() + rank2id_[group].capacity()) * 4;
+        }
+        std::cout << "dictionary compressed to " << (bytes >> 20) << " MB." << std::endl;
+    }
+
     bool LoadPredicate() {
         std::ifstream predicate_in(dict_path_ + "/predicates", std::ofstream::out | std::ofstream::binary);
         std::string predicate;
@@ -452,16 +600,14 @@ class Dictionary {
         hash_map<std::string, uint>().swap(predicates_);
         hash_map<std::string, uint>().swap(shared_);
 
-        std::vector<std::string>().swap(id2subject_);
+        std::vector<uint64_t>().swap(id2subject_);
         std::vector<std::string>().swap(id2predicate_);
-        std::vector<std::string>().swap(id2object_);
-        std::vector<std::string>().swap(id2shared_);
+        std::vector<uint64_t>().swap(id2object_);
+        std::vector<uint64_t>().swap(id2shared_);
 
         hash_map<std::string, uint>().swap(predicate2id_);
-        for (uint i = 0; i < 6; i++) {
-            hash_map<std::string, uint>().swap(subject2id_[i]);
-            hash_map<std::string, uint>().swap(object2id_[i]);
-            hash_map<std::string, uint>().swap(shared2id_[i]);
+        for (uint i = 0; i < kPartitions; i++) {
+            hash_map<std::string_view, uint>().swap(entity2id_[i]);
         }
     }
 
@@ -485,7 +631,9 @@ class Dictionary {
         return pso;
     }
 
-    void Load() {
+    // compressed 为 true 时实体按前缀压缩保存，内存更少，未命中的查找更慢，见 FrontCodedStrings
+    void Load(bool compressed = false) {
+        compressed_ = compressed;
         LoadPredicate();
 
         std::vector<std::future<bool>> sub_task_list;
@@ -513,25 +661,45 @@ class Dictionary {
         for (std::future<bool>& task : sub_task_list) {
             task.get();
         }
+        if (compressed_) {
+            Compress();
+            return;
+        }
+        sub_task_list.clear();
+        for (uint partition = 0; partition < kPartitions; partition++) {
+            sub_task_list.emplace_back(
+                std::async(std::launch::async, &Dictionary::BuildPartition, this, partition));
+        }
+        for (std::future<bool>& task : sub_task_list) {
+            task.get();
+        }
 
         // std::cout << subjects.size() << predicates.size() << " " << objects.size() << " " << shared.size()
         //           << std::endl;
     }
 
-    std::string& ID2String(uint id, Pos pos) {
+    // 非压缩模式下返回的字符串在字典销毁之前有效；压缩模式下实体被解码到 scratch 中，
+    // 返回的字符串在 scratch 下一次被修改之前有效
+    std::string_view ID2String(uint id, Pos pos, std::string& scratch) {
         if (pos == kPredicate) {
             return id2predicate_[id];
         }
 
+        // id 为 0 表示变量没有绑定
+        if (id == 0)
+            return std::string_view();
         if (id <= shared_cnt_) {
-            return id2shared_[id];
+            return EntityString(2, id2shared_, id, scratch);
         }
 
+        // 实体的 id 是全局唯一的，按 id 所在的区间取值，
+        // 这样同一个变量在不同的查询（如 UNION 分支）中位置不同也能正确解码
         switch (pos) {
             case kSubject:
-                return id2subject_[id - shared_cnt_];
             case kObject:
-                return id2object_[id - shared_cnt_ - subject_cnt_];
+                if (id <= shared_cnt_ + subject_cnt_)
+                    return EntityString(0, id2subject_, id - shared_cnt_, scratch);
+                return EntityString(1, id2object_, id - shared_cnt_ - subject_cnt_, scratch);
             default:
                 break;
         }
@@ -0,0 +1,283 @@
+#ifndef FRONT_CODING_HPP
+#define FRONT_CODING_HPP
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mmap.hpp"
+
+// IRI 的命名空间是从开头到最后一个 '/' 或 '#' 为止的部分，例如 <http://www.wikidata.org/entity/。
+// 只有被多个块头使用的命名空间才编号，编号从 1 开始，0 表示不使用命名空间
+class Namespaces {
+   public:
+    static constexpr uint kMinUses = 2;
+
+    Namespaces() = default;
+
+    Namespaces(const Namespaces&) = delete;
+    Namespaces& operator=(const Namespaces&) = delete;
+
+    static std::string_view Of(std::string_view term) {
+        if (term.empty() || term[0] != '<')
+            return std::string_view();
+        size_t end = term.find_last_of("/#");
+        return end == std::string_view::npos ? std::string_view() : term.substr(0, end + 1);
+    }
+
+    // headers 是所有块头，至少被 kMinUses 个块头使用的命名空间按字典序编号
+    void Build(const std::vector<std::string_view>& headers) {
+        hash_map<std::string_view, uint> uses;
+        for (std::string_view header : headers) {
+            std::string_view ns = Of(header);
+            if (!ns.empty())
+                uses[ns]++;
+        }
+        for (const auto& [ns, count] : uses) {
+            if (count >= kMinUses)
+                names_.emplace_back(ns);
+        }
+        std::sort(names_.begin(), names_.end());
+        // names_ 不再改变，键可以指向其中的字符串
+        for (uint i = 0; i < names_.size(); i++) {
+            ids_[names_[i]] = i + 1;
+        }
+    }
+
+    uint Id(std::string_view term) const {
+        auto it = ids_.find(Of(term));
+        return it != ids_.end() ? it->second : 0;
+    }
+
+    std::string_view Name(uint id) const { return id ? std::string_view(names_[id - 1]) : std::string_view(); }
+
+    size_t bytes() const {
+        size_t bytes = names_.capacity() * sizeof(std::string);
+        bytes += ids_.size() * (sizeof(std::string_view) + sizeof(uint));
+        for (const auto& name : names_) {
+            bytes += name.capacity();
+        }
+        return bytes;
+    }
+
+   private:
+    std::vector<std::string> names_;
+    hash_map<std::string_view, uint> ids_;
+};
+
+// 按字典序排好的字符串的前缀压缩（front coding）存储。每 kBlockSize 个字符串一块，
+// 块中第一个字符串（块头）保存完整的内容，其中 IRI 的命名空间（例如 <http://www.wikidata.org/entity/）
+// 用编号代替；之后的字符串只保存和前一个字符串的公共前缀长度以及剩下的后缀。
+// 按位置取字符串最多解码一块。查找时先在定长的块键（块头去掉所有字符串的公共前缀后的前 8 个字节）上二分查找，
+// 块键相同时才比较完整的块头，然后在块中逐项比较，整个过程不分配内存
+class FrontCodedStrings {
+   public:
+    static constexpr uint kBlockSize = 8;
+
+    FrontCodedStrings() = default;
+
+    // terms 按字典序排序，namespaces 在这个对象使用期间必须有效
+    FrontCodedStrings(const std::vector<std::string_view>& terms, const Namespaces* namespaces)
+        : namespaces_(namespaces), size_(terms.size()) {
+        // 排好序的字符串的公共前缀就是第一个和最后一个字符串的公共前缀
+        if (!terms.empty())
+            common_prefix_.assign(terms.front(), 0, CommonPrefix(terms.front(), terms.back(), 0));
+        block_offsets_.reserve((terms.size() + kBlockSize - 1) / kBlockSize);
+        block_keys_.reserve(block_offsets_.capacity());
+        for (uint i = 0; i < terms.size(); i++) {
+            std::string_view term = terms[i];
+            if (i % kBlockSize == 0) {
+                block_offsets_.push_back(data_.size());
+                block_keys_.push_back(Key(term));
+                uint ns = namespaces_->Id(term);
+                term.remove_prefix(namespaces_->Name(ns).size());
+                PutVarint(ns);
+            } else {
+                size_t common = CommonPrefix(terms[i - 1], term, 0);
+                PutVarint(common);
+                term.remove_prefix(common);
+            }
+            PutVarint(term.size());
+            data_.append(term);
+        }
+        data_.shrink_to_fit();
+    }
+
+    uint size() const { return size_; }
+
+    size_t bytes() const {
+        return data_.capacity() + (block_offsets_.capacity() + block_keys_.capacity()) * sizeof(uint64_t) +
+               common_prefix_.capacity();
+    }
+
+    // 把第 rank 个字符串解码到 term 中，term 原有的内存会被复用
+    void Get(uint rank, std::string& term) const {
+        const char* pos = DecodeHeader(rank / kBlockSize, term);
+        for (uint i = 0; i < rank % kBlockSize; i++) {
+            pos = DecodeNext(pos, term);
+        }
+    }
+
+    // term 的位置，不存在时返回 size()
+    uint Find(std::string_view term) const {
+        if (size_ == 0 || term.compare(0, common_prefix_.size(), common_prefix_) != 0)
+            return size_;
+
+        // 块键小于 term 的块头一定小于 term，块键大于 term 的块头一定大于 term，
+        // 块键相同的块 [lo, hi) 需要比较完整的块头，找到最后一个块头不大于 term 的块
+        uint64_t key = Key(term);
+        uint hi = CountKeys(key, block_keys_.size(), true);
+        uint lo = hi > 0 && block_keys_[hi - 1] == key ? CountKeys(key, hi, false) : hi;
+        while (lo < hi) {
+            uint mid = (lo + hi) / 2;
+            size_t matched;
+            const char* unused;
+            if (CompareHeader(term, mid, matched, unused) > 0)
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        if (lo == 0)
+            return size_;
+        return FindInBlock(term, lo - 1);
+    }
+
+   private:
+    // a 和 b 从第 from 个字符开始的公共前缀延伸到的位置
+    static size_t CommonPrefix(std::string_view a, std::string_view b, size_t from) {
+        size_t limit = std::min(a.size(), b.size());
+        while (from < limit && a[from] == b[from])
+            from++;
+        return from;
+    }
+
+    // 去掉公共前缀后的前 8 个字节按大端序组成的整数，不足 8 个字节时补 0。
+    // 字符串中没有 '\0'，所以块键的大小关系和字符串的字典序一致（块键相同时不确定）
+    uint64_t Key(std::string_view term) const {
+        uint64_t key = 0;
+        for (size_t i = 0; i < 8; i++) {
+            size_t pos = common_prefix_.size() + i;
+            key = (key << 8) | (pos < term.size() ? static_cast<unsigned char>(term[pos]) : 0);
+        }
+        return key;
+    }
+
+    // 前 n 个块键中小于 key（inclusive 时小于等于 key）的个数。
+    // 不用 std::upper_bound，没有分支的二分查找避免了每一步的分支预测失败，在块键上快 3～4 倍
+    uint CountKeys(uint64_t key, size_t n, bool inclusive) const {
+        if (n == 0)
+            return 0;
+        const uint64_t* base = block_keys_.data();
+        while (n > 1) {
+            size_t half = n / 2;
+            base = (inclusive ? base[half] <= key : base[half] < key) ? base + half : base;
+            n -= half;
+        }
+        return (base - block_keys_.data()) + (inclusive ? *base <= key : *base < key);
+    }
+
+    // 顺序比较块中的字符串，matched 是当前字符串和 term 的公共前缀长度。
+    // 下一个字符串和当前字符串的公共前缀 common 大于 matched 时，它在 matched 处的字符和当前字符串相同，仍然小于 term；
+    // common 小于 matched 时，它在 common 处的字符大于当前字符串也就是 term 的字符，所以大于 term；
+    // 相等时才需要比较剩下的后缀
+    uint FindInBlock(std::string_view term, uint block) const {
+        size_t matched;
+        const char* pos;
+        int cmp = CompareHeader(term, block, matched, pos);
+        uint rank = block * kBlockSize;
+        uint end = std::min<uint>(size_, rank + kBlockSize);
+        while (cmp < 0) {
+            if (++rank == end)
+                return size_;
+            size_t common, length;
+            pos = GetVarint(pos, common);
+            pos = GetVarint(pos, length);
+            std::string_view suffix(pos, length);
+            pos += length;
+            if (common > matched)
+                continue;
+            if (common < matched)
+                return size_;
+            matched = CommonPrefix(term.substr(common), suffix, 0) + common;
+            cmp = Compare(term, matched, suffix, matched - common, common + length);
+        }
+        return cmp == 0 ? rank : size_;
+    }
+
+    // 当前字符串（长度 length）和 term 的公共前缀长度是 matched，rest 是当前字符串从 offset 开始的部分，
+    // 包含第 matched 个字符。返回当前字符串和 term 比较的结果
+    static int Compare(std::string_view term, size_t matched, std::string_view rest, size_t offset, size_t length) {
+        if (matched == length)
+            return matched == term.size() ? 0 : -1;
+        if (matched == term.size())
+            return 1;
+        return static_cast<unsigned char>(rest[offset]) < static_cast<unsigned char>(term[matched]) ? -1 : 1;
+    }
+
+    void PutVarint(size_t value) {
+        while (value >= 0x80) {
+            data_.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        data_.push_back(static_cast<char>(value));
+    }
+
+    static const char* GetVarint(const char* pos, size_t& value) {
+        value = 0;
+        for (uint shift = 0;; shift += 7) {
+            unsigned char byte = *pos++;
+            value |= size_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return pos;
+        }
+    }
+
+    // 块头的命名空间和剩下的部分
+    const char* ReadHeader(uint block, std::string_view& ns, std::string_view& rest) const {
+        size_t id, length;
+        const char* pos = GetVarint(data_.data() + block_offsets_[block], id);
+        pos = GetVarint(pos, length);
+        ns = namespaces_->Name(id);
+        rest = std::string_view(pos, length);
+        return pos + length;
+    }
+
+    const char* DecodeHeader(uint block, std::string& term) const {
+        std::string_view ns, rest;
+        const char* pos = ReadHeader(block, ns, rest);
+        term.assign(ns);
+        term.append(rest);
+        return pos;
+    }
+
+    const char* DecodeNext(const char* pos, std::string& term) const {
+        size_t common, length;
+        pos = GetVarint(pos, common);
+        pos = GetVarint(pos, length);
+        term.resize(common);
+        term.append(pos, length);
+        return pos + length;
+    }
+
+    // 不拼接块头，分命名空间和剩下的部分两段比较，返回块头和 term 比较的结果，
+    // matched 是两者的公共前缀长度，next 指向块中的下一个字符串
+    int CompareHeader(std::string_view term, uint block, size_t& matched, const char*& next) const {
+        std::string_view ns, rest;
+        next = ReadHeader(block, ns, rest);
+        matched = CommonPrefix(term, ns, 0);
+        if (matched < ns.size())
+            return Compare(term, matched, ns, matched, ns.size() + rest.size());
+        matched = CommonPrefix(term.substr(ns.size()), rest, 0) + ns.size();
+        return Compare(term, matched, rest, matched - ns.size(), ns.size() + rest.size());
+    }
+
+    const Namespaces* namespaces_ = nullptr;
+    uint size_ = 0;
+    std::string common_prefix_;
+    std::vector<uint64_t> block_offsets_;
+    std::vector<uint64_t> block_keys_;
+    std::string data_;
+};
+
+#endif  // FRONT_CODING_HPP
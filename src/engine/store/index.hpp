@@ -5,6 +5,12 @@
 #include <parallel_hashmap/phmap.h>
 #include "./linked_array.hpp"
 
+// DB_INFO 的第 7 个字段保存索引格式的标志位，旧版本的 DB_INFO 只有前 6 个字段
+enum DBInfoFlag : uint {
+    // 每个实体在 PO_PREDICATE_MAP、PS_PREDICATE_MAP 中的 (pid, offset, size) 按 pid 升序排列
+    kSortedPredicateMaps = 1,
+};
+
 struct PredicateIndex {
     phmap::btree_set<uint> s_set_;
     phmap::btree_set<uint> o_set_;
@@ -8,6 +8,7 @@
 #include <sys/mman.h>
 #include <unistd.h>
 #include <algorithm>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <future>
@@ -21,6 +22,7 @@
 #include "dictionary.hpp"
 #include "index.hpp"
 #include "mmap.hpp"
+#include "statistics.hpp"
 
 namespace fs = std::filesystem;
 
@@ -51,6 +53,9 @@ class IndexBuilder {
 
     std::vector<std::pair<uint, uint>> predicate_rank_;
 
+    // pid - 1 -> 谓词的统计信息，每个谓词只由一个线程更新
+    std::vector<PredicateStatistics> predicate_statistics_;
+
     hash_map<uint, std::vector<std::pair<uint, uint>>>* pso_;
 
     // e_id -> (s_to_p, o_to_p)
@@ -108,6 +113,10 @@ class IndexBuilder {
 
         BuildPredicateMaps();
 
+        StorePredicateStatistics();
+
+        StoreCharacteristicSets();
+
         StoreDBInfo();
 
         return true;
@@ -124,6 +133,7 @@ class IndexBuilder {
     }
 
     void CalculatePredicateRank() {
+        predicate_statistics_ = std::vector<PredicateStatistics>(dict.predicate_cnt());
         for (uint pid = 1; pid <= dict.predicate_cnt(); pid++) {
             pso_->at(pid).shrink_to_fit();
             uint i = 0, size = pso_->at(pid).size();
@@ -224,6 +234,8 @@ class IndexBuilder {
             ps_set = &predicate_indexes[pid - 1].s_set_;
             po_set = &predicate_indexes[pid - 1].o_set_;
             // std::cout << pid << " " << ps_set->size() << " " << po_set->size() << std::endl;
+            predicate_statistics_[pid - 1].distinct_subjects_ = ps_set->size();
+            predicate_statistics_[pid - 1].distinct_objects_ = po_set->size();
 
             predicate_index_[(pid - 1) * 2] = predicate_index_arrays_file_offset;
             for (auto it = ps_set->begin(); it != ps_set->end(); it++) {
@@ -330,6 +342,8 @@ class IndexBuilder {
             }
         }
 
+        SortPredicateMaps();
+
         po_predicate_map_.CloseMap();
         ps_predicate_map_.CloseMap();
         if (entity_index_arrays_file_size_ != arrays_offset) {
@@ -344,6 +358,30 @@ class IndexBuilder {
                   << std::endl;
     }
 
+    // 多个线程按谓词写入 predicate map，每个实体的 (pid, offset, size) 是写入的顺序，
+    // 全部写完后按 pid 排序，查询时可以二分查找。写完后 predicate_map_file_offset_ 是每个实体的结束位置
+    void SortPredicateMaps() {
+        struct Entry {
+            uint pid_;
+            uint offset_;
+            uint size_;
+        };
+        static_assert(sizeof(Entry) == 3 * sizeof(uint), "predicate map entries are three consecutive uint");
+        auto by_pid = [](const Entry& a, const Entry& b) { return a.pid_ < b.pid_; };
+
+        uint po_begin = 0;
+        uint ps_begin = 0;
+        for (uint id = 1; id <= dict.max_id(); id++) {
+            auto [po_end, ps_end] = predicate_map_file_offset_[id - 1];
+            Entry* po_entries = reinterpret_cast<Entry*>(po_predicate_map_.map_ + po_begin);
+            Entry* ps_entries = reinterpret_cast<Entry*>(ps_predicate_map_.map_ + ps_begin);
+            std::sort(po_entries, po_entries + (po_end - po_begin) / 3, by_pid);
+            std::sort(ps_entries, ps_entries + (ps_end - ps_begin) / 3, by_pid);
+            po_begin = po_end;
+            ps_begin = ps_end;
+        }
+    }
+
     void SubBuildPredicateMaps(std::queue<uint>* task_queue,
                                uint* arrays_offset,
                                double* finished,
@@ -407,6 +445,9 @@ class IndexBuilder {
                 mtx.unlock();
 
                 arrays_size_sum += size;
+                // 重复的三元组在 predicate map 中只保存一次，三元组个数按 (p, s) 的宾语个数累加
+                if (s_to_o)
+                    predicate_statistics_[pid - 1].triples_ += size;
 
                 vm[map_offset] = pid;
                 map_offset++;
@@ -435,8 +476,48 @@ class IndexBuilder {
         }
     }
 
+    void StorePredicateStatistics() {
+        uint file_size = predicate_statistics_.size() * sizeof(PredicateStatistics);
+        if (file_size == 0)
+            return;
+
+        MMap<uint> vm = MMap<uint>(db_index_path_ + "PREDICATE_STATS", file_size);
+        std::memcpy(vm.map_, predicate_statistics_.data(), file_size);
+        vm.CloseMap();
+    }
+
+    void StoreCharacteristicSets() {
+        auto beg = std::chrono::high_resolution_clock::now();
+
+        entity_index_ = MMap<uint>(db_index_path_ + "ENTITY_INDEX", entity_index_file_size_);
+        po_predicate_map_ = MMap<uint>(db_index_path_ + "PO_PREDICATE_MAP", po_predicate_map_file_size_);
+
+        // 每个实体在 PO_PREDICATE_MAP 中的 (pid, offset, size) 到下一个实体的起始位置为止
+        CharacteristicSets characteristic_sets;
+        std::vector<std::pair<uint, uint>> predicates;
+        for (uint id = 1; id <= dict.max_id(); id++) {
+            uint begin = entity_index_[(id - 1) * 2];
+            uint end = id != dict.max_id() ? entity_index_[id * 2] : po_predicate_map_file_size_ / 4;
+            predicates.clear();
+            for (uint offset = begin; offset + 3 <= end; offset += 3) {
+                predicates.emplace_back(po_predicate_map_[offset], po_predicate_map_[offset + 2]);
+            }
+            characteristic_sets.Add(predicates);
+        }
+        characteristic_sets.Finish();
+        characteristic_sets.Store(db_index_path_ + "CHARACTERISTIC_SETS");
+
+        entity_index_.CloseMap();
+        po_predicate_map_.CloseMap();
+
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::milli> diff = end - beg;
+        std::cout << "store " << characteristic_sets.size() << " characteristic sets takes " << diff.count()
+                  << " ms." << std::endl;
+    }
+
     void StoreDBInfo() {
-        MMap<uint> vm = MMap<uint>(db_index_path_ + "DB_INFO", 6 * 4);
+        MMap<uint> vm = MMap<uint>(db_index_path_ + "DB_INFO", 7 * 4);
 
         vm[0] = predicate_index_file_size_;
         vm[1] = predicate_index_arrays_file_size_;
@@ -444,7 +525,7 @@ class IndexBuilder {
         vm[3] = po_predicate_map_file_size_;
         vm[4] = ps_predicate_map_file_size_;
         vm[5] = entity_index_arrays_file_size_;
-        // vm[6] = dict.triplet_cnt();
+        vm[6] = DBInfoFlag::kSortedPredicateMaps;
         // vm[7] = dict.max_id();
         // vm[8] = dict.predicate_cnt();
         // vm[9] = entity_size_;
@@ -2,13 +2,22 @@
 #define INDEX_RETRIEVER_HPP
 
 #include <limits.h>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <memory>
 #include <thread>
 #include <vector>
 #include "../query/result.hpp"
+#include "access_trace.hpp"
 #include "dictionary.hpp"
+#include "index.hpp"
+#include "load_policy.hpp"
 #include "mmap.hpp"
+#include "posting_cache.hpp"
+#include "statistics.hpp"
 
 using Result = ResultList::Result;
 
@@ -34,8 +43,22 @@ class IndexRetriever {
     MMap<uint> po_predicate_map_;
     MMap<uint> entity_index_arrays_;
 
+    // 谓词集合不超过这个大小时顺序查找，比二分查找的分支预测更好
+    static constexpr uint kLinearSearchPredicates = 8;
+
+    // 新版本构建的数据库每个实体的谓词集合按 pid 排序，可以二分查找
+    bool sorted_predicate_maps_ = false;
+
+    // 谓词集合至少有这么多谓词的实体（类型、国家等热点实体）查找的结果放在 posting_cache_ 中，
+    // 谓词更少的实体直接查找比访问缓存更快
+    static constexpr uint kCachedPredicates = 64;
+    std::unique_ptr<PostingCache> posting_cache_ = std::make_unique<PostingCache>();
+
     void LoadDBInfo() {
-        MMap<uint> vm = MMap<uint>(db_index_path_ + "DB_INFO", 6 * 4);
+        // 旧版本的 DB_INFO 只有 6 个字段，不能按 7 个字段映射，否则会修改文件大小
+        std::string path = db_index_path_ + "DB_INFO";
+        bool has_flags = std::filesystem::exists(path) && std::filesystem::file_size(path) >= 7 * 4;
+        MMap<uint> vm = MMap<uint>(path, (has_flags ? 7 : 6) * 4, MMap<uint>::kReadOnly);
 
         predicate_index_file_size_ = vm[0];
         predicate_index_arrays_file_size_ = vm[1];
@@ -43,27 +66,162 @@ class IndexRetriever {
         po_predicate_map_file_size_ = vm[3];
         ps_predicate_map_file_size_ = vm[4];
         entity_index_arrays_file_size_ = vm[5];
+        if (has_flags)
+            sorted_predicate_maps_ = vm[6] & DBInfoFlag::kSortedPredicateMaps;
 
         vm.CloseMap();
     }
 
+    LoadPolicies load_policies_;
+
     void InitMMap() {
-        predicate_index_ = MMap<uint>(db_index_path_ + "PREDICATE_INDEX", predicate_index_file_size_);
+        auto beg = std::chrono::high_resolution_clock::now();
+        size_t locked = 0;
+        bool warmed = false;
+
+        predicate_index_ = OpenIndexFile("PREDICATE_INDEX", predicate_index_file_size_, locked, warmed);
         predicate_index_arrays_ =
-            MMap<uint>(db_index_path_ + "PREDICATE_INDEX_ARRAYS", predicate_index_arrays_file_size_);
-        entity_index_ = MMap<uint>(db_index_path_ + "ENTITY_INDEX", entity_index_file_size_);
-        po_predicate_map_ = MMap<uint>(db_index_path_ + "PO_PREDICATE_MAP", po_predicate_map_file_size_);
-        ps_predicate_map_ = MMap<uint>(db_index_path_ + "PS_PREDICATE_MAP", ps_predicate_map_file_size_);
+            OpenIndexFile("PREDICATE_INDEX_ARRAYS", predicate_index_arrays_file_size_, locked, warmed);
+        entity_index_ = OpenIndexFile("ENTITY_INDEX", entity_index_file_size_, locked, warmed);
+        po_predicate_map_ = OpenIndexFile("PO_PREDICATE_MAP", po_predicate_map_file_size_, locked, warmed);
+        ps_predicate_map_ = OpenIndexFile("PS_PREDICATE_MAP", ps_predicate_map_file_size_, locked, warmed);
         entity_index_arrays_ =
-            MMap<uint>(db_index_path_ + "ENTITY_INDEX_ARRAYS", entity_index_arrays_file_size_);
+            OpenIndexFile("ENTITY_INDEX_ARRAYS", entity_index_arrays_file_size_, locked, warmed);
+
+        std::vector<AccessTrace::File> traced = TracedFiles();
+        if (!traced.empty()) {
+            auto replay_beg = std::chrono::high_resolution_clock::now();
+            uint threads = std::min(8u, std::max(1u, std::thread::hardware_concurrency()));
+            size_t prefetched = AccessTrace::Replay(db_index_path_ + "ACCESS_TRACE", traced, threads);
+            auto replay_end = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double, std::milli> diff = replay_end - replay_beg;
+            std::cout << "replay access trace takes " << diff.count() << " ms, " << (prefetched >> 20)
+                      << " MB prefetched." << std::endl;
+        }
+
+        if (warmed) {
+            auto end = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double, std::milli> diff = end - beg;
+            std::cout << "warm up index takes " << diff.count() << " ms, " << (locked >> 20) << " MB locked."
+                      << std::endl;
+        }
+    }
+
+    // 按照加载策略以只读方式映射一个索引文件。populate 和 mlock 在这里同步读入整个文件，
+    // willneed 和 hugepage 只是提示内核在后台预读
+    MMap<uint> OpenIndexFile(const std::string& file, uint size, size_t& locked, bool& warmed) {
+        LoadPolicy policy = load_policies_.Get(file);
+        auto beg = std::chrono::high_resolution_clock::now();
+
+        int flags = policy == LoadPolicy::kPopulate ? MAP_POPULATE : 0;
+        MMap<uint> vm = MMap<uint>(db_index_path_ + file, size, MMap<uint>::kReadOnly, flags);
+        switch (policy) {
+            case LoadPolicy::kWillNeed:
+                vm.Advise(MADV_WILLNEED);
+                break;
+            case LoadPolicy::kHugePage:
+#ifdef MADV_HUGEPAGE
+                vm.Advise(MADV_HUGEPAGE);
+#endif
+                vm.Advise(MADV_WILLNEED);
+                break;
+            case LoadPolicy::kLock:
+                if (vm.Lock())
+                    locked += size;
+                break;
+            default:
+                break;
+        }
+
+        if (policy == LoadPolicy::kPopulate || policy == LoadPolicy::kLock) {
+            warmed = true;
+            auto end = std::chrono::high_resolution_clock::now();
+            std::chrono::duration<double, std::milli> diff = end - beg;
+            std::cout << "load " << file << " (" << LoadPolicies::Name(policy) << ", " << (size >> 20)
+                      << " MB) takes " << diff.count() << " ms." << std::endl;
+        }
+        return vm;
+    }
+
+    // 加载策略是 trace 的索引文件，编号是在 LoadPolicies::kFiles 中的位置
+    std::vector<AccessTrace::File> TracedFiles() {
+        std::pair<MMap<uint>*, uint> files[] = {{&predicate_index_, predicate_index_file_size_},
+                                                {&predicate_index_arrays_, predicate_index_arrays_file_size_},
+                                                {&entity_index_, entity_index_file_size_},
+                                                {&po_predicate_map_, po_predicate_map_file_size_},
+                                                {&ps_predicate_map_, ps_predicate_map_file_size_},
+                                                {&entity_index_arrays_, entity_index_arrays_file_size_}};
+        std::vector<AccessTrace::File> traced;
+        for (uint id = 0; id < std::size(files); id++) {
+            if (load_policies_.Get(LoadPolicies::kFiles[id]) == LoadPolicy::kTrace && files[id].first->map_)
+                traced.push_back({id, files[id].first->map_, files[id].second});
+        }
+        return traced;
+    }
+
+    // PREDICATE_STATS 按 pid 顺序保存每个谓词的 PredicateStatistics，只读取其中几个字段，不复制到内存
+    MMap<uint> predicate_statistics_file_;
+    // 旧版本构建的数据库没有 PREDICATE_STATS，加载时从索引计算
+    std::vector<PredicateStatistics> computed_statistics_;
+    const PredicateStatistics* predicate_statistics_ = nullptr;
+    uint predicate_statistics_cnt_ = 0;
+
+    void LoadPredicateStatistics() {
+        std::string path = db_index_path_ + "PREDICATE_STATS";
+        uint predicate_cnt = predicate_index_file_size_ / 4 / 2;
+        if (std::filesystem::exists(path) &&
+            std::filesystem::file_size(path) == predicate_cnt * sizeof(PredicateStatistics)) {
+            if (predicate_cnt == 0)
+                return;
+            predicate_statistics_file_ =
+                MMap<uint>(path, predicate_cnt * sizeof(PredicateStatistics), MMap<uint>::kReadOnly);
+            predicate_statistics_ = reinterpret_cast<const PredicateStatistics*>(predicate_statistics_file_.map_);
+            predicate_statistics_cnt_ = predicate_cnt;
+            return;
+        }
+
+        // 主语、宾语的个数来自 PREDICATE_INDEX，三元组个数来自 po predicate map 中的 (pid, offset, size)
+        computed_statistics_ = std::vector<PredicateStatistics>(predicate_cnt);
+        for (uint pid = 1; pid <= predicate_cnt; pid++) {
+            computed_statistics_[pid - 1].distinct_subjects_ = GetSSetSize(pid);
+            computed_statistics_[pid - 1].distinct_objects_ = GetOSetSize(pid);
+        }
+        for (uint i = 0; i + 2 < po_predicate_map_file_size_ / 4; i += 3) {
+            uint pid = po_predicate_map_[i];
+            if (pid == 0 || pid > predicate_cnt)
+                continue;
+            computed_statistics_[pid - 1].triples_ += po_predicate_map_[i + 2];
+        }
+        predicate_statistics_ = computed_statistics_.data();
+        predicate_statistics_cnt_ = predicate_cnt;
+    }
+
+    CharacteristicSets characteristic_sets_;
+
+    // 旧版本构建的数据库没有 CHARACTERISTIC_SETS，加载时从 PO_PREDICATE_MAP 计算
+    void LoadCharacteristicSets() {
+        if (characteristic_sets_.Load(db_index_path_ + "CHARACTERISTIC_SETS"))
+            return;
+
+        std::vector<std::pair<uint, uint>> predicates;
+        for (uint id = 1; id <= dict_.max_id(); id++) {
+            auto [offset, size] = GetPrediacateSet(id, Order::kSPO);
+            predicates.clear();
+            for (uint i = 0; i < size; i++) {
+                predicates.emplace_back(po_predicate_map_[offset + 3 * i], po_predicate_map_[offset + 3 * i + 2]);
+            }
+            characteristic_sets_.Add(predicates);
+        }
+        characteristic_sets_.Finish();
     }
 
     Dictionary dict_;
 
     // IndexMap maps_;
 
-    std::vector<std::shared_ptr<Result>> ps_sets_;
-    std::vector<std::shared_ptr<Result>> po_sets_;
+    // 每个谓词的 S/O 集合，直接指向 PREDICATE_INDEX_ARRAYS 的映射，不复制数据，页面在第一次访问时才读入
+    std::vector<Result> ps_sets_;
+    std::vector<Result> po_sets_;
 
     bool PreLoadTree() {
         uint s_array_offset;
@@ -71,6 +229,8 @@ class IndexRetriever {
         uint o_array_offset;
         uint o_array_size;
 
+        ps_sets_.reserve(dict_.predicate_cnt());
+        po_sets_.reserve(dict_.predicate_cnt());
         for (uint pid = 1; pid <= dict_.predicate_cnt(); pid++) {
             s_array_offset = predicate_index_[(pid - 1) * 2];
             o_array_offset = predicate_index_[(pid - 1) * 2 + 1];
@@ -80,17 +240,8 @@ class IndexRetriever {
             else
                 o_array_size = predicate_index_arrays_file_size_ / 4 - o_array_offset;
 
-            uint* set = new uint[s_array_size];
-            for (uint i = 0; i < s_array_size; i++) {
-                set[i] = predicate_index_arrays_[s_array_offset + i];
-            }
-            ps_sets_.push_back(std::make_shared<Result>(set, s_array_size, true));
-
-            set = new uint[o_array_size];
-            for (uint i = 0; i < o_array_size; i++) {
-                set[i] = predicate_index_arrays_[o_array_offset + i];
-            }
-            po_sets_.push_back(std::make_shared<Result>(set, o_array_size, true));
+            ps_sets_.emplace_back(predicate_index_arrays_.Range(s_array_offset, s_array_size), s_array_size);
+            po_sets_.emplace_back(predicate_index_arrays_.Range(o_array_offset, o_array_size), o_array_size);
         }
         return true;
     }
@@ -102,20 +253,25 @@ class IndexRetriever {
 
     IndexRetriever() {}
 
-    IndexRetriever(std::string db_name) : db_name_(db_name) {
+    // load_policies 决定每个索引文件的预读方式，见 LoadPolicies
+    IndexRetriever(std::string db_name, const LoadPolicies& load_policies = LoadPolicies())
+        : db_name_(db_name), load_policies_(load_policies) {
         auto beg = std::chrono::high_resolution_clock::now();
 
         db_dictionary_path_ = "./DB_DATA_ARCHIVE/" + db_name_ + "/dictionary/";
         db_index_path_ = "./DB_DATA_ARCHIVE/" + db_name_ + "/index/";
 
         LoadDBInfo();
-        InitMMap();
 
+        // 字典和索引文件同时加载
         dict_ = Dictionary(db_dictionary_path_);
-        std::thread t([&]() { dict_.Load(); });
+        std::thread t([&]() { dict_.Load(load_policies_.compressed_dictionary()); });
+        InitMMap();
 
         PreLoadTree();
+        LoadPredicateStatistics();
         t.join();
+        LoadCharacteristicSets();
 
         // LoadData();
 
@@ -125,15 +281,25 @@ class IndexRetriever {
     }
 
     void close() {
+        // 解除映射之前记录 trace 策略的索引文件驻留在内存中的页面，下次加载时预读；数据库已经被删除时不记录
+        std::vector<AccessTrace::File> traced = TracedFiles();
+        if (!traced.empty() && std::filesystem::exists(db_index_path_) &&
+            !AccessTrace::Record(db_index_path_ + "ACCESS_TRACE", traced))
+            std::cerr << "warning: failed to record the access trace of " << db_name_ << std::endl;
+
         predicate_index_.CloseMap();
         predicate_index_arrays_.CloseMap();
         entity_index_.CloseMap();
         po_predicate_map_.CloseMap();
         ps_predicate_map_.CloseMap();
         entity_index_arrays_.CloseMap();
+        if (predicate_statistics_file_.map_ != nullptr)
+            predicate_statistics_file_.CloseMap();
+        posting_cache_->Clear();
     }
 
-    std::string& ID2String(uint id, Pos pos) { return dict_.ID2String(id, pos); }
+    // 见 Dictionary::ID2String，默认的非压缩字典不会写 scratch
+    std::string_view ID2String(uint id, Pos pos, std::string& scratch) { return dict_.ID2String(id, pos, scratch); }
 
     uint String2ID(const std::string& str, Pos pos) { return dict_.String2ID(str, pos); }
 
@@ -143,7 +309,7 @@ class IndexRetriever {
 
     uint entity_cnt() { return dict_.subject_cnt() + dict_.object_cnt() + dict_.shared_cnt(); }
 
-    std::shared_ptr<Result> GetSSet(uint pid) {
+    Result GetSSet(uint pid) {
         // uint s_array_offset = predicate_index_[(pid - 1) * 4];
         // uint o_array_offset = predicate_index_[(pid - 1) * 4 + 2];
         // uint s_array_size = o_array_offset - s_array_offset;
@@ -153,11 +319,7 @@ class IndexRetriever {
         return ps_sets_[pid - 1];
     }
 
-    uint GetSSetSize(uint pid) {
-        return predicate_index_[(pid - 1) * 4 + 2] - predicate_index_[(pid - 1) * 4];
-    }
-
-    std::shared_ptr<Result> GetOSet(uint pid) {
+    Result GetOSet(uint pid) {
         // uint o_array_offset = predicate_index_[(pid - 1) * 4 + 2];
         // uint o_array_size;
         // if (pid != predicate_cnt_)
@@ -170,108 +332,157 @@ class IndexRetriever {
         return po_sets_[pid - 1];
     }
 
+    // 以下是查询计划使用的统计信息，只读取 PREDICATE_INDEX、PREDICATE_STATS 和 predicate map，
+    // 不会访问 S/O 集合和 ENTITY_INDEX_ARRAYS 中的数据，pid 不存在时都返回 0
+
+    // 谓词 pid 的不同主语的个数
+    uint GetSSetSize(uint pid) {
+        if (pid == 0 || pid > predicate_index_file_size_ / 4 / 2)
+            return 0;
+        return predicate_index_.At((pid - 1) * 2 + 1) - predicate_index_.At((pid - 1) * 2);
+    }
+
+    // 谓词 pid 的不同宾语的个数
     uint GetOSetSize(uint pid) {
-        uint o_array_offset = predicate_index_[(pid - 1) * 4 + 2];
-        if (pid != dict_.predicate_cnt())
-            return predicate_index_[pid * 4] - o_array_offset;
+        uint predicate_cnt = predicate_index_file_size_ / 4 / 2;
+        if (pid == 0 || pid > predicate_cnt)
+            return 0;
+        uint o_array_offset = predicate_index_.At((pid - 1) * 2 + 1);
+        if (pid != predicate_cnt)
+            return predicate_index_.At(pid * 2) - o_array_offset;
         else
             return predicate_index_arrays_file_size_ / 4 - o_array_offset;
     }
 
-    uint PSSize(uint pid) { return predicate_index_[(pid - 1) * 4 + 1]; }
+    // 谓词 pid 的三元组个数
+    uint GetTripleCount(uint pid) {
+        const PredicateStatistics* stats = GetPredicateStatistics(pid);
+        return stats ? stats->triples_ : 0;
+    }
+
+    bool has_statistics() const { return predicate_statistics_cnt_ != 0; }
 
-    uint POSize(uint pid) { return predicate_index_[(pid - 1) * 4 + 3]; }
+    const PredicateStatistics* GetPredicateStatistics(uint pid) const {
+        if (pid == 0 || pid > predicate_statistics_cnt_)
+            return nullptr;
+        return &predicate_statistics_[pid - 1];
+    }
+
+    const CharacteristicSets& characteristic_sets() const { return characteristic_sets_; }
+
+    PostingCache& posting_cache() { return *posting_cache_; }
 
     std::pair<uint, uint> GetPrediacateSet(uint e, Order order) {
         uint offset;
         uint size;
+        // 最后一个实体的谓词集合到对应的 predicate map 的末尾为止
         if (order == Order::kSPO) {
-            offset = entity_index_[(e - 1) * 2];
-            return {offset, (entity_index_[e * 2] - offset) / 3};
+            offset = entity_index_.At((e - 1) * 2);
+            if (e != dict_.max_id())
+                size = (entity_index_.At(e * 2) - offset) / 3;
+            else
+                size = (po_predicate_map_file_size_ / 4 - offset) / 3;
+            return {offset, size};
         }
 
-        offset = entity_index_[(e - 1) * 2 + 1];
+        offset = entity_index_.At((e - 1) * 2 + 1);
         if (e != dict_.max_id()) {
-            size = (entity_index_[e * 2 + 1] - offset) / 3;
+            size = (entity_index_.At(e * 2 + 1) - offset) / 3;
         } else {
-            size = (entity_index_file_size_ / 4 - offset) / 3;
+            size = (ps_predicate_map_file_size_ / 4 - offset) / 3;
         }
 
         return {offset, size};
     }
 
-    std::shared_ptr<Result> GetByPS(uint p, uint s) {
-        if (s > dict_.shared_cnt() + dict_.subject_cnt())
-            return std::make_shared<Result>();
+    // 谓词 p 在谓词集合 predicate_set 中的位置，不存在时返回集合的大小
+    uint FindPredicate(const MMap<uint>& predicate_map, std::pair<uint, uint> predicate_set, uint p) const {
+        uint size = predicate_set.second;
+        const uint* entries = predicate_map.Range(predicate_set.first, 3 * size);
+        if (!sorted_predicate_maps_ || size <= kLinearSearchPredicates) {
+            for (uint i = 0; i < size; i++) {
+                if (entries[3 * i] == p)
+                    return i;
+            }
+            return size;
+        }
 
-        std::pair<uint, uint> predicate_set = GetPrediacateSet(s, Order::kSPO);
+        // 无分支的二分查找，base 是最后一个 pid 不大于 p 的位置
+        uint base = 0;
+        uint n = size;
+        while (n > 1) {
+            uint half = n / 2;
+            base = entries[3 * (base + half)] <= p ? base + half : base;
+            n -= half;
+        }
+        return entries[3 * base] == p ? base : size;
+    }
 
-        uint array_offset;
-        uint array_size;
-
-        uint pos = 0;
-        for (; pos < predicate_set.second; pos++) {
-            if (po_predicate_map_[predicate_set.first + 3 * pos] == p) {
-                array_offset = po_predicate_map_[predicate_set.first + 3 * pos + 1];
-                array_size = po_predicate_map_[predicate_set.first + 3 * pos + 2];
-                if (array_size != 1)
-                    return std::make_shared<Result>(&entity_index_arrays_[array_offset], array_size);
-                else {
-                    uint* data = (uint*)malloc(4);
-                    data[0] = array_offset;
-                    return std::make_shared<Result>(data, 1, true);
-                }
-            }
+    // entity 的谓词集合中谓词 p 的实体集合，不存在时返回空的 Result
+    Result Locate(const MMap<uint>& predicate_map,
+                  std::pair<uint, uint> predicate_set,
+                  uint p,
+                  uint entity,
+                  PostingCache::Direction direction) {
+        bool cached = predicate_set.second >= kCachedPredicates;
+        Result result;
+        if (cached && posting_cache_->Get(p, entity, direction, result))
+            return result;
+
+        uint pos = FindPredicate(predicate_map, predicate_set, p);
+        if (pos != predicate_set.second) {
+            // 只有一个实体时，offset 字段保存的就是这个实体，直接指向它
+            const uint* entry = predicate_map.Range(predicate_set.first + 3 * pos, 3);
+            result = entry[2] != 1 ? Result(entity_index_arrays_.Range(entry[1], entry[2]), entry[2])
+                                   : Result(entry + 1, 1);
         }
-        return std::make_shared<Result>();
+        if (cached)
+            posting_cache_->Put(p, entity, direction, result);
+        return result;
+    }
+
+    Result GetByPS(uint p, uint s) {
+        if (s == 0 || s > dict_.shared_cnt() + dict_.subject_cnt())
+            return Result();
+
+        return Locate(po_predicate_map_, GetPrediacateSet(s, Order::kSPO), p, s, PostingCache::kObjects);
     }
 
+    // (p, s) 的宾语个数，不存在时返回 0
     uint GetByPSSize(uint p, uint s) {
+        if (s == 0 || s > dict_.shared_cnt() + dict_.subject_cnt())
+            return 0;
         std::pair<uint, uint> predicate_set = GetPrediacateSet(s, Order::kSPO);
+        if (predicate_set.second >= kCachedPredicates)
+            return Locate(po_predicate_map_, predicate_set, p, s, PostingCache::kObjects).size();
 
-        for (uint i = 0; i < predicate_set.second; i++) {
-            if (po_predicate_map_[predicate_set.first + 3 * i] == p) {
-                return po_predicate_map_[predicate_set.first + 3 * i + 2];
-            }
-        }
-        return UINT_MAX;
+        uint pos = FindPredicate(po_predicate_map_, predicate_set, p);
+        if (pos == predicate_set.second)
+            return 0;
+        return po_predicate_map_.At(predicate_set.first + 3 * pos + 2);
     }
 
-    std::shared_ptr<Result> GetByPO(uint p, uint o) {
-        if (dict_.shared_cnt() < o && o <= dict_.shared_cnt() + dict_.subject_cnt())
-            return std::make_shared<Result>();
-
-        std::pair<uint, uint> predicate_set = GetPrediacateSet(o, Order::kOPS);
+    Result GetByPO(uint p, uint o) {
+        if (o == 0 || o > dict_.max_id() ||
+            (dict_.shared_cnt() < o && o <= dict_.shared_cnt() + dict_.subject_cnt()))
+            return Result();
 
-        uint array_offset;
-        uint array_size;
-
-        uint pos = 0;
-        for (; pos < predicate_set.second; pos++) {
-            if (ps_predicate_map_[predicate_set.first + 3 * pos] == p) {
-                array_offset = ps_predicate_map_[predicate_set.first + 3 * pos + 1];
-                array_size = ps_predicate_map_[predicate_set.first + 3 * pos + 2];
-                if (array_size != 1) {
-                    return std::make_shared<Result>(&entity_index_arrays_[array_offset], array_size);
-                } else {
-                    uint* data = (uint*)malloc(4);
-                    data[0] = array_offset;
-                    return std::make_shared<Result>(data, 1, true);
-                }
-            }
-        }
-        return std::make_shared<Result>();
+        return Locate(ps_predicate_map_, GetPrediacateSet(o, Order::kOPS), p, o, PostingCache::kSubjects);
     }
 
+    // (p, o) 的主语个数，不存在时返回 0
     uint GetByPOSize(uint p, uint o) {
+        if (o == 0 || o > dict_.max_id() ||
+            (dict_.shared_cnt() < o && o <= dict_.shared_cnt() + dict_.subject_cnt()))
+            return 0;
         std::pair<uint, uint> predicate_set = GetPrediacateSet(o, Order::kOPS);
+        if (predicate_set.second >= kCachedPredicates)
+            return Locate(ps_predicate_map_, predicate_set, p, o, PostingCache::kSubjects).size();
 
-        for (uint i = 0; i < predicate_set.second; i++) {
-            if (ps_predicate_map_[predicate_set.first + 3 * i] == p) {
-                return ps_predicate_map_[predicate_set.first + 3 * i + 2];
-            }
-        }
-        return UINT_MAX;
+        uint pos = FindPredicate(ps_predicate_map_, predicate_set, p);
+        if (pos == predicate_set.second)
+            return 0;
+        return ps_predicate_map_.At(predicate_set.first + 3 * pos + 2);
     }
 };
 
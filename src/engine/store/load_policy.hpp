@@ -0,0 +1,107 @@
+#ifndef LOAD_POLICY_HPP
+#define LOAD_POLICY_HPP
+
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "mmap.hpp"
+
+// 查询时映射索引文件的方式，决定重启后的第一批查询是否需要逐页从磁盘读入索引
+enum class LoadPolicy {
+    kLazy,      // 不预读，页面在第一次访问时读入
+    kWillNeed,  // madvise(MADV_WILLNEED)，内核在后台预读，不阻塞加载
+    kPopulate,  // MAP_POPULATE，加载时读入整个文件并建立页表
+    kLock,      // mlock，加载时读入整个文件并锁定在内存中，不会被换出
+    kHugePage,  // madvise(MADV_HUGEPAGE) 后在后台预读，内核支持文件的透明大页时可以减少 TLB 缺失
+    kTrace,     // 关闭时记录驻留在内存中的页面，下次加载时只读入这些页面，见 AccessTrace
+};
+
+// 每个索引文件的加载策略。配置是逗号分隔的项，每一项是所有文件的策略，或者 FILE:POLICY 指定一个文件的策略，
+// 例如 "populate,ENTITY_INDEX_ARRAYS:lazy"。没有配置时 S/O 集合所在的两个文件在后台预读，其他文件不预读。
+// DICTIONARY:compressed 以前缀压缩的方式加载字典，DICTIONARY:plain 是默认的方式
+class LoadPolicies {
+   public:
+    static constexpr const char* kFiles[] = {"PREDICATE_INDEX",  "PREDICATE_INDEX_ARRAYS", "ENTITY_INDEX",
+                                             "PO_PREDICATE_MAP", "PS_PREDICATE_MAP",       "ENTITY_INDEX_ARRAYS"};
+
+    LoadPolicies() = default;
+
+    // 配置有错误时抛出 std::invalid_argument
+    explicit LoadPolicies(const std::string& spec) {
+        std::stringstream ss(spec);
+        std::string item;
+        while (std::getline(ss, item, ',')) {
+            if (item.empty())
+                continue;
+            size_t colon = item.find(':');
+            if (colon == std::string::npos) {
+                default_ = Parse(item);
+                continue;
+            }
+            std::string file = item.substr(0, colon);
+            if (file == "DICTIONARY") {
+                std::string mode = item.substr(colon + 1);
+                if (mode != "plain" && mode != "compressed")
+                    throw std::invalid_argument("unknown dictionary mode " + mode + ", expected plain or compressed");
+                compressed_dictionary_ = mode == "compressed";
+                continue;
+            }
+            bool known = false;
+            for (const char* name : kFiles) {
+                known |= file == name;
+            }
+            if (!known)
+                throw std::invalid_argument("unknown index file " + file + " in load policy");
+            files_[file] = Parse(item.substr(colon + 1));
+        }
+    }
+
+    LoadPolicy Get(const std::string& file) const {
+        auto it = files_.find(file);
+        if (it != files_.end())
+            return it->second;
+        if (default_)
+            return *default_;
+        return file == "PREDICATE_INDEX" || file == "PREDICATE_INDEX_ARRAYS" ? LoadPolicy::kWillNeed
+                                                                              : LoadPolicy::kLazy;
+    }
+
+    bool compressed_dictionary() const { return compressed_dictionary_; }
+
+    static const char* Name(LoadPolicy policy) {
+        switch (policy) {
+            case LoadPolicy::kLazy:
+                return "lazy";
+            case LoadPolicy::kWillNeed:
+                return "willneed";
+            case LoadPolicy::kPopulate:
+                return "populate";
+            case LoadPolicy::kLock:
+                return "mlock";
+            case LoadPolicy::kHugePage:
+                return "hugepage";
+            case LoadPolicy::kTrace:
+                return "trace";
+        }
+        return "";
+    }
+
+   private:
+    static LoadPolicy Parse(const std::string& name) {
+        for (auto policy : {LoadPolicy::kLazy, LoadPolicy::kWillNeed, LoadPolicy::kPopulate, LoadPolicy::kLock,
+                            LoadPolicy::kHugePage, LoadPolicy::kTrace}) {
+            if (name == Name(policy))
+                return policy;
+        }
+        throw std::invalid_argument("unknown load policy " + name +
+                                    ", expected lazy, willneed, populate, mlock, hugepage or trace");
+    }
+
+    std::optional<LoadPolicy> default_;
+    bool compressed_dictionary_ = false;
+    hash_map<std::string, LoadPolicy> files_;
+};
+
+#endif  // LOAD_POLICY_HPP
@@ -4,7 +4,11 @@
 #include <fcntl.h>
 #include <parallel_hashmap/phmap.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
 #include <string>
 
 template <typename Key, typename Value>
@@ -12,14 +16,26 @@ using hash_map = phmap::flat_hash_map<Key, Value>;
 
 template <typename T>
 struct MMap {
-    T* map_;
+    // kReadWrite 用于构建索引，文件按 fileSize 创建或截断；kReadOnly 用于查询时打开已有的文件，
+    // 以只读方式映射，关闭时不需要 msync，多个进程可以安全地共享同一份页缓存
+    enum Mode { kReadWrite, kReadOnly };
+
+    T* map_ = nullptr;
     int fd_;
     std::string path_;
     uint fileSize_;  // bytes
+    Mode mode_ = kReadWrite;
 
     MMap() {}
 
-    MMap(std::string path, uint fileSize) : path_(path), fileSize_(fileSize) {
+    // flags 是只读映射额外的 mmap 标志，例如 MAP_POPULATE
+    MMap(std::string path, uint fileSize, Mode mode = kReadWrite, int flags = 0)
+        : path_(path), fileSize_(fileSize), mode_(mode) {
+        if (mode_ == kReadOnly) {
+            OpenReadOnly(flags);
+            return;
+        }
+
         fd_ = open((path).c_str(), O_RDWR | O_CREAT, (mode_t)0600);
         if (fd_ == -1) {
             perror("Error opening file for mmap");
@@ -41,11 +57,11 @@ struct MMap {
     }
 
     void CloseMap() {
-        if (msync(map_, fileSize_, MS_SYNC) == -1) {
+        if (mode_ == kReadWrite && msync(map_, fileSize_, MS_SYNC) == -1) {
             perror("Error syncing memory to disk");
         }
 
-        if (munmap(map_, fileSize_) == -1) {
+        if (map_ != nullptr && munmap(map_, fileSize_) == -1) {
             perror("Error unmapping memory");
         }
 
@@ -54,6 +70,23 @@ struct MMap {
         }
     }
 
+    // 告诉内核之后的访问方式，例如 MADV_WILLNEED 在后台预读整个文件，只是提示，失败时忽略
+    void Advise(int advice) {
+        if (map_ != nullptr && map_ != MAP_FAILED && fileSize_ > 0)
+            madvise(map_, fileSize_, advice);
+    }
+
+    // 把整个文件锁定在内存中，超过 RLIMIT_MEMLOCK 等原因失败时返回 false。munmap 时自动解锁
+    bool Lock() {
+        if (map_ == nullptr || fileSize_ == 0)
+            return true;
+        if (mlock(map_, fileSize_) == -1) {
+            perror(("Error locking " + path_ + " in memory").c_str());
+            return false;
+        }
+        return true;
+    }
+
     void Resize(uint new_size) {
         fileSize_ = new_size;
         if (ftruncate(fd_, fileSize_) == -1) {
@@ -71,6 +104,57 @@ struct MMap {
 
         return error;
     }
+
+    // 查询热路径使用的访问方式，不检查越界，只在打开 EPEI_CHECK_BOUNDS 编译时检查
+    const T& At(uint offset) const {
+        CheckRange(offset, 1);
+        return map_[offset];
+    }
+
+    // 从 offset 开始的 size 个元素，检查方式与 At 相同
+    const T* Range(uint offset, uint size) const {
+        CheckRange(offset, size);
+        return map_ + offset;
+    }
+
+    const T* data() const { return map_; }
+
+   private:
+    void CheckRange([[maybe_unused]] uint offset, [[maybe_unused]] uint size) const {
+#ifdef EPEI_CHECK_BOUNDS
+        if (uint64_t(offset) + size > fileSize_ / sizeof(T)) {
+            std::cerr << "MMap: range [" << offset << ", " << uint64_t(offset) + size << ") out of range of "
+                      << path_ << std::endl;
+            abort();
+        }
+#endif
+    }
+
+    void OpenReadOnly(int flags) {
+        fd_ = open(path_.c_str(), O_RDONLY);
+        if (fd_ == -1) {
+            perror(("Error opening " + path_ + " for mmap").c_str());
+            exit(1);
+        }
+
+        // 只读映射不能扩展文件，超出文件末尾的页面访问时会触发 SIGBUS
+        struct stat st;
+        if (fstat(fd_, &st) == -1 || uint64_t(st.st_size) < fileSize_) {
+            std::cerr << "Error mapping " << path_ << ": the file is smaller than " << fileSize_ << " bytes"
+                      << std::endl;
+            close(fd_);
+            exit(1);
+        }
+        if (fileSize_ == 0)
+            return;
+
+        map_ = static_cast<T*>(mmap(nullptr, fileSize_, PROT_READ, MAP_SHARED | flags, fd_, 0));
+        if (map_ == MAP_FAILED) {
+            perror("Error mapping file for mmap");
+            close(fd_);
+            exit(1);
+        }
+    }
 };
 
 #endif
\ No newline at end of file
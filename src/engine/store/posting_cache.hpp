@@ -0,0 +1,157 @@
+#ifndef POSTING_CACHE_HPP
+#define POSTING_CACHE_HPP
+
+#include <atomic>
+#include <memory>
+
+#include "../query/result.hpp"
+
+using Result = ResultList::Result;
+
+// 缓存 GetByPS/GetByPO 在 predicate map 中找到的实体集合，键是 (p, 实体, 方向)。
+// Result 只是指向索引的视图，缓存只保存位置，和索引文件的映射同时失效。
+// 命中的代价必须比二分查找低，所以查找不加锁：缓存是固定大小的表，每个桶占一个缓存行，保存两项，
+// 用版本号（seqlock）检查读到的项是否被同时修改。插入时桶正在被其他线程修改就放弃插入。
+// 满了以后淘汰桶中没有被再次访问过的项。命中和未命中次数按桶分到 kShards 组计数器上，减少线程之间的竞争
+class PostingCache {
+   public:
+    // kObjects 是 (p, s) 的宾语，kSubjects 是 (p, o) 的主语
+    enum Direction : uint { kObjects = 0, kSubjects = 1 };
+
+    static constexpr uint kShards = 16;
+    static constexpr size_t kDefaultCapacity = 1 << 16;
+
+    // capacity 是最多缓存的项数，向上取整为 2 的幂
+    explicit PostingCache(size_t capacity = kDefaultCapacity) {
+        size_t buckets = 1;
+        while (buckets * kWays < capacity)
+            buckets *= 2;
+        mask_ = buckets - 1;
+        buckets_ = std::make_unique<Bucket[]>(buckets);
+    }
+
+    bool Get(uint p, uint entity, Direction direction, Result& result) {
+        uint64_t key = Key(p, entity, direction);
+        uint64_t hash = Hash(key);
+        Bucket& bucket = buckets_[hash & mask_];
+        Shard& shard = shards_[(hash >> 32) % kShards];
+
+        uint version = bucket.version_.load(std::memory_order_acquire);
+        if (!(version & 1)) {
+            for (uint way = 0; way < kWays; way++) {
+                if (bucket.keys_[way].load(std::memory_order_relaxed) != key)
+                    continue;
+                const uint* start = bucket.starts_[way].load(std::memory_order_relaxed);
+                uint size = bucket.sizes_[way].load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (bucket.version_.load(std::memory_order_relaxed) != version)
+                    break;
+                // 已经设置时不再写，避免热点项所在的缓存行在线程之间来回传递
+                if (!bucket.referenced_[way].load(std::memory_order_relaxed))
+                    bucket.referenced_[way].store(true, std::memory_order_relaxed);
+                result = Result(start, size);
+                shard.hits_.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        shard.misses_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    void Put(uint p, uint entity, Direction direction, Result result) {
+        uint64_t key = Key(p, entity, direction);
+        Bucket& bucket = buckets_[Hash(key) & mask_];
+
+        uint version = bucket.version_.load(std::memory_order_relaxed);
+        if ((version & 1) ||
+            !bucket.version_.compare_exchange_strong(version, version + 1, std::memory_order_acquire))
+            return;
+        std::atomic_thread_fence(std::memory_order_release);
+
+        // 优先替换相同或者空的项，其次是没有被再次访问过的项，都被访问过时清除访问标记并替换第一项
+        uint victim = kWays;
+        for (uint way = 0; way < kWays && victim == kWays; way++) {
+            uint64_t existing = bucket.keys_[way].load(std::memory_order_relaxed);
+            if (existing == key || existing == kEmpty)
+                victim = way;
+        }
+        for (uint way = 0; way < kWays && victim == kWays; way++) {
+            if (!bucket.referenced_[way].load(std::memory_order_relaxed))
+                victim = way;
+        }
+        if (victim == kWays) {
+            for (uint way = 0; way < kWays; way++) {
+                bucket.referenced_[way].store(false, std::memory_order_relaxed);
+            }
+            victim = 0;
+        }
+
+        bucket.keys_[victim].store(key, std::memory_order_relaxed);
+        bucket.starts_[victim].store(result.data(), std::memory_order_relaxed);
+        bucket.sizes_[victim].store(result.size(), std::memory_order_relaxed);
+        bucket.referenced_[victim].store(false, std::memory_order_relaxed);
+        bucket.version_.store(version + 2, std::memory_order_release);
+    }
+
+    // 关闭数据库时调用，不能和 Get、Put 同时执行
+    void Clear() {
+        for (size_t i = 0; i <= mask_; i++) {
+            for (uint way = 0; way < kWays; way++) {
+                buckets_[i].keys_[way].store(kEmpty, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    size_t capacity() const { return (mask_ + 1) * kWays; }
+
+    size_t hits() const {
+        size_t hits = 0;
+        for (const auto& shard : shards_) {
+            hits += shard.hits_.load(std::memory_order_relaxed);
+        }
+        return hits;
+    }
+
+    size_t misses() const {
+        size_t misses = 0;
+        for (const auto& shard : shards_) {
+            misses += shard.misses_.load(std::memory_order_relaxed);
+        }
+        return misses;
+    }
+
+   private:
+    static constexpr uint kWays = 2;
+    // 谓词 id 小于 2^31，所以合法的键的最高位总是 0
+    static constexpr uint64_t kEmpty = ~0ull;
+
+    struct alignas(64) Bucket {
+        // 奇数表示正在修改
+        std::atomic<uint> version_{0};
+        std::atomic<bool> referenced_[kWays] = {};
+        std::atomic<uint64_t> keys_[kWays] = {kEmpty, kEmpty};
+        std::atomic<const uint*> starts_[kWays] = {};
+        std::atomic<uint> sizes_[kWays] = {};
+    };
+
+    struct alignas(64) Shard {
+        std::atomic<size_t> hits_{0};
+        std::atomic<size_t> misses_{0};
+    };
+
+    static uint64_t Key(uint p, uint entity, Direction direction) {
+        return (uint64_t(p) << 33) | (uint64_t(entity) << 1) | direction;
+    }
+
+    static uint64_t Hash(uint64_t key) {
+        key ^= key >> 31;
+        key *= 0x9E3779B97F4A7C15ull;
+        return key ^ (key >> 29);
+    }
+
+    size_t mask_;
+    std::unique_ptr<Bucket[]> buckets_;
+    Shard shards_[kShards];
+};
+
+#endif  // POSTING_CACHE_HPP
@@ -0,0 +1,178 @@
+#ifndef STATISTICS_HPP
+#define STATISTICS_HPP
+
+#include <sys/types.h>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "mmap.hpp"
+
+// 一个谓词的统计信息，构建索引时按谓词 id 顺序写入 index/PREDICATE_STATS，
+// 查询计划用它估计每个变量的候选集合和连接后中间结果的大小
+struct PredicateStatistics {
+    uint triples_ = 0;
+    uint distinct_subjects_ = 0;
+    uint distinct_objects_ = 0;
+
+    // 任取一个主语和一个宾语，它们之间有这个谓词的概率
+    double Selectivity() const {
+        if (distinct_subjects_ == 0 || distinct_objects_ == 0)
+            return 0;
+        return 1.0 * triples_ / distinct_subjects_ / distinct_objects_;
+    }
+};
+
+static_assert(sizeof(PredicateStatistics) == 3 * sizeof(uint),
+              "PREDICATE_STATS stores PredicateStatistics as consecutive uint");
+
+// 特征集合：谓词集合完全相同的主语归为一个特征集合，记录主语的个数和每个谓词的三元组个数。
+// 星形查询 { ?s p1 ?o1 . ?s p2 ?o2 . ... } 的主语只能来自包含所有 p1、p2 ... 的特征集合，
+// 用这些集合估计主语个数和每个谓词的平均宾语个数，不需要假设谓词之间相互独立
+class CharacteristicSets {
+   public:
+    // 只保留主语最多的 kMaxSets 个特征集合，其余集合的主语很少，忽略它们只会略微低估
+    static constexpr size_t kMaxSets = 1 << 16;
+
+    struct Set {
+        uint count_ = 0;
+        // 升序的谓词
+        std::vector<uint> predicates_;
+        // predicates_[i] 在这些主语上的三元组个数
+        std::vector<uint> occurrences_;
+    };
+
+    // 加入一个主语的所有 (谓词, 宾语个数)
+    void Add(std::vector<std::pair<uint, uint>>& predicates) {
+        if (predicates.empty())
+            return;
+        std::sort(predicates.begin(), predicates.end());
+        std::string key(predicates.size() * sizeof(uint), '\0');
+        for (size_t i = 0; i < predicates.size(); i++) {
+            std::memcpy(&key[i * sizeof(uint)], &predicates[i].first, sizeof(uint));
+        }
+
+        auto it = set_ids_.find(key);
+        if (it == set_ids_.end()) {
+            it = set_ids_.emplace(key, sets_.size()).first;
+            sets_.emplace_back();
+            for (const auto& [pid, size] : predicates) {
+                sets_.back().predicates_.push_back(pid);
+            }
+            sets_.back().occurrences_.resize(predicates.size());
+        }
+        Set& set = sets_[it->second];
+        set.count_++;
+        for (size_t i = 0; i < predicates.size(); i++) {
+            set.occurrences_[i] += predicates[i].second;
+        }
+    }
+
+    // 所有主语加入后按主语个数从多到少排序，只保留前 kMaxSets 个
+    void Finish() {
+        hash_map<std::string, uint>().swap(set_ids_);
+        std::sort(sets_.begin(), sets_.end(), [](const Set& a, const Set& b) { return a.count_ > b.count_; });
+        if (sets_.size() > kMaxSets)
+            sets_.resize(kMaxSets);
+    }
+
+    // 文件按 uint 保存：集合个数，然后每个集合依次是 count、谓词个数 k、k 个谓词、k 个三元组个数
+    void Store(const std::string& path) const {
+        uint file_size = 1;
+        for (const auto& set : sets_) {
+            file_size += 2 + set.predicates_.size() * 2;
+        }
+
+        MMap<uint> vm = MMap<uint>(path, file_size * 4);
+        uint offset = 0;
+        vm[offset++] = sets_.size();
+        for (const auto& set : sets_) {
+            vm[offset++] = set.count_;
+            vm[offset++] = set.predicates_.size();
+            for (uint pid : set.predicates_) {
+                vm[offset++] = pid;
+            }
+            for (uint occurrence : set.occurrences_) {
+                vm[offset++] = occurrence;
+            }
+        }
+        vm.CloseMap();
+    }
+
+    bool Load(const std::string& path) {
+        if (!std::filesystem::exists(path))
+            return false;
+        uint file_size = std::filesystem::file_size(path);
+        if (file_size < 4)
+            return false;
+
+        MMap<uint> vm = MMap<uint>(path, file_size, MMap<uint>::kReadOnly);
+        uint words = file_size / 4;
+        uint offset = 0;
+        uint set_cnt = vm[offset++];
+        if (set_cnt > words) {
+            vm.CloseMap();
+            return false;
+        }
+        sets_.resize(set_cnt);
+        for (auto& set : sets_) {
+            if (offset + 2 > words)
+                break;
+            set.count_ = vm[offset++];
+            uint k = vm[offset++];
+            if (offset + 2 * k > words)
+                break;
+            set.predicates_.assign(&vm.map_[offset], &vm.map_[offset + k]);
+            set.occurrences_.assign(&vm.map_[offset + k], &vm.map_[offset + 2 * k]);
+            offset += 2 * k;
+        }
+        vm.CloseMap();
+        return true;
+    }
+
+    // 估计拥有 predicates 中所有谓词的主语个数，以及这些主语上每个谓词的平均宾语个数。
+    // predicates 需要升序且不重复
+    double EstimateStar(const std::vector<uint>& predicates, std::vector<double>& fanouts) const {
+        double subjects = 0;
+        fanouts.assign(predicates.size(), 0);
+        for (const auto& set : sets_) {
+            if (set.predicates_.size() < predicates.size())
+                continue;
+            // 两个有序数组，判断 predicates 是否是 set.predicates_ 的子集
+            size_t j = 0;
+            for (size_t i = 0; i < set.predicates_.size() && j < predicates.size(); i++) {
+                if (set.predicates_[i] == predicates[j])
+                    j++;
+                else if (set.predicates_[i] > predicates[j])
+                    break;
+            }
+            if (j != predicates.size())
+                continue;
+
+            subjects += set.count_;
+            j = 0;
+            for (size_t i = 0; j < predicates.size(); i++) {
+                if (set.predicates_[i] == predicates[j])
+                    fanouts[j++] += set.occurrences_[i];
+            }
+        }
+        for (auto& fanout : fanouts) {
+            fanout = subjects > 0 ? fanout / subjects : 0;
+        }
+        return subjects;
+    }
+
+    bool empty() const { return sets_.empty(); }
+
+    size_t size() const { return sets_.size(); }
+
+   private:
+    std::vector<Set> sets_;
+    // 构建时谓词集合 -> sets_ 中的位置
+    hash_map<std::string, uint> set_ids_;
+};
+
+#endif  // STATISTICS_HPP